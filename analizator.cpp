@@ -0,0 +1,371 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Analizator przebiegu idiokracji
+ *
+ * Czyta przebieg w formacie tekstowym (timeline.txt albo wyjscie dekodera)
+ * w jednym przejsciu i podaje:
+ *  - dla kazdej firmy bilans zgod przyjetych i wyslanych do niej, osobno
+ *    dla kliniki i okienek; liczone sa tylko wiadomosci AGREE, informacja
+ *    o wyjsciu z kliniki jest rozsylana do wszystkich pozostalych firm, wiec
+ *    liczy sie jako zgoda wyslana do kazdej z nich, a rozstrzygniecia
+ *    pierwszenstwa nie sa wiadomosciami i w bilansie ich nie ma,
+ *  - histogramy czasu oczekiwania na klinike i na okienko,
+ *  - najwieksza zajetosc kliniki i okienek oraz kazde przekroczenie K i L.
+ *
+ * Plik jest mapowany do pamieci i dzielony na kawalki wg granic linii,
+ * ktore watki analizuja rownolegle. Zajetosc zalezy od kolejnosci linii,
+ * wiec watki zbieraja jedynie wejscia i wyjscia, a zajetosc liczy jeden
+ * przebieg po kawalkach w kolejnosci pliku.
+ *
+*/
+
+#define KLINIKA          0
+#define OKNO             1
+#define LICZBA_KUBELKOW  24 // Kubelek b to czasy z [2^(b-1), 2^b) ms, kubelek 0 to ponizej 1 ms
+
+// Zmiana zajetosci zasobu przez firme, w kolejnosci z pliku
+typedef struct {
+    int linia;   // Numer linii w kawalku
+    int zasob;
+    int id;
+    int miejsca; // Nowa liczba jednostek zajmowanych przez firme
+} tzmiana;
+
+typedef struct {
+    std::vector<int> przyjete[2];  // Zgody przyjete przez firme
+    std::vector<int> wyslaneDo[2]; // Zgody wyslane do firmy
+    std::vector<int> wyjscia;      // Informacje o wyjsciu z kliniki rozeslane przez firme
+    int firmy;                     // Najwiekszy napotkany id firmy + 1
+    long long kubelki[2][LICZBA_KUBELKOW];
+    double sumaCzasow[2];
+    long long liczbaCzasow[2];
+    std::vector<tzmiana> zmiany;
+    int linie;
+    int nieznane;                  // Linie, ktorych nie udalo sie odczytac
+} tstatystyki;
+
+typedef struct {
+    const char * poczatek;
+    const char * koniec;
+    tstatystyki * wynik;
+} tkawalek;
+
+void policz(std::vector<int> &licznik, int id) {
+    if (id < 0) return;
+    if (id >= (int) licznik.size()) licznik.resize(id + 1, 0);
+    licznik[id]++;
+}
+
+// Czyta liczbe calkowita od p, przesuwa p za nia
+bool czytajLiczbe(const char * &p, const char * koniec, int &wynik) {
+    bool ujemna = false;
+    if (p < koniec && *p == '-') {
+        ujemna = true;
+        p++;
+    }
+    if (p >= koniec || *p < '0' || *p > '9') return false;
+    wynik = 0;
+    while (p < koniec && *p >= '0' && *p <= '9')
+        wynik = wynik * 10 + (*p++ - '0');
+    if (ujemna) wynik = -wynik;
+    return true;
+}
+
+// Ostatnia liczba w linii, zwykle id firmy, ktorej dotyczy komunikat
+int ostatniaLiczba(const char * poczatek, const char * koniec) {
+    const char * p = koniec;
+    while (p > poczatek && (p[-1] < '0' || p[-1] > '9')) p--;
+    while (p > poczatek && p[-1] >= '0' && p[-1] <= '9') p--;
+    int wynik = -1;
+    czytajLiczbe(p, koniec, wynik);
+    return wynik;
+}
+
+// Szuka napisu w linii, zwraca wskaznik za nim albo NULL
+const char * znajdz(const char * poczatek, const char * koniec, const char * napis) {
+    size_t n = strlen(napis);
+    for (const char * p = poczatek; p + n <= koniec; p++)
+        if (*p == *napis && memcmp(p, napis, n) == 0)
+            return p + n;
+    return NULL;
+}
+
+bool zaczynaSie(const char * poczatek, const char * koniec, const char * napis) {
+    size_t n = strlen(napis);
+    return (size_t) (koniec - poczatek) >= n && memcmp(poczatek, napis, n) == 0;
+}
+
+void dodajCzas(tstatystyki &s, int zasob, double ms) {
+    int b = 0;
+    while (b < LICZBA_KUBELKOW - 1 && ms >= (double) (1LL << b)) b++;
+    s.kubelki[zasob][b]++;
+    s.sumaCzasow[zasob] += ms;
+    s.liczbaCzasow[zasob]++;
+}
+
+void zmiana(tstatystyki &s, int zasob, int id, int miejsca) {
+    tzmiana z = {s.linie, zasob, id, miejsca};
+    s.zmiany.push_back(z);
+}
+
+// Analizuje jedna linie "<lamport> <id> : Firma <id> <komunikat>"
+void analizujLinie(tstatystyki &s, const char * p, const char * koniec) {
+    int lamport, id;
+    if (!czytajLiczbe(p, koniec, lamport) || p >= koniec || *p++ != ' ' || !czytajLiczbe(p, koniec, id)) {
+        s.nieznane++;
+        return;
+    }
+    const char * tresc = znajdz(p, koniec, "> ");
+    if (tresc == NULL) {
+        s.nieznane++;
+        return;
+    }
+    if (id >= s.firmy) s.firmy = id + 1;
+    const char * x;
+
+    // Zgody przyjete przez firme id
+    if (znajdz(tresc, koniec, "otrzymala wiadomosc KLINIKA_AGREE") != NULL) {
+        policz(s.przyjete[KLINIKA], id);
+        return;
+    }
+    if (znajdz(tresc, koniec, "otrzymala wiadomosc OKNO_AGREE") != NULL) {
+        policz(s.przyjete[OKNO], id);
+        return;
+    }
+
+    // Zgody wyslane do firmy podanej na koncu linii
+    if (znajdz(tresc, koniec, "wysyla wiadomosc KLINIKA_AGREE") != NULL) {
+        policz(s.wyslaneDo[KLINIKA], ostatniaLiczba(tresc, koniec));
+        return;
+    }
+    if (znajdz(tresc, koniec, "wysyla wiadomosc OKNO_AGREE") != NULL) {
+        policz(s.wyslaneDo[OKNO], ostatniaLiczba(tresc, koniec));
+        return;
+    }
+    if (znajdz(tresc, koniec, "wysyla zgode do skolejkowanego") != NULL) {
+        int zasob = zaczynaSie(tresc, koniec, "opuszcza okienko") ? OKNO : KLINIKA;
+        policz(s.wyslaneDo[zasob], ostatniaLiczba(tresc, koniec));
+        return;
+    }
+
+    // Czasy oczekiwania na dostep
+    if ((x = znajdz(tresc, koniec, "czekala na ")) != NULL) {
+        int zasob = zaczynaSie(x, koniec, "klinike") ? KLINIKA : OKNO;
+        while (x < koniec && *x != ' ') x++;
+        double ms = strtod(x, NULL); // Linia konczy sie dalszym tekstem, wiec strtod nie wyjdzie poza plik
+        dodajCzas(s, zasob, ms);
+        return;
+    }
+
+    // Zajetosc kliniki i okienek
+    if (znajdz(tresc, koniec, "otrzymala dostep do kliniki") != NULL ||
+        zaczynaSie(tresc, koniec, "rozeslala informacje o zwolnieniu miejsc") ||
+        zaczynaSie(tresc, koniec, "zostaje w klinice")) {
+        zmiana(s, KLINIKA, id, ostatniaLiczba(tresc, koniec));
+        return;
+    }
+    if (zaczynaSie(tresc, koniec, "rozeslala informacje o wyjsciu")) {
+        if (zaczynaSie(tresc, koniec, "rozeslala informacje o wyjsciu do pozostalych firm"))
+            policz(s.wyjscia, id);
+        zmiana(s, KLINIKA, id, 0);
+        return;
+    }
+    if (znajdz(tresc, koniec, "dostep do okienka") != NULL) {
+        zmiana(s, OKNO, id, 1);
+        return;
+    }
+    if (zaczynaSie(tresc, koniec, "skonczyla papierkologie"))
+        zmiana(s, OKNO, id, 0);
+}
+
+void analizujKawalek(tkawalek * k) {
+    tstatystyki &s = *k->wynik;
+    const char * p = k->poczatek;
+    while (p < k->koniec) {
+        const char * nl = (const char *) memchr(p, '\n', k->koniec - p);
+        const char * koniecLinii = nl ? nl : k->koniec;
+        if (koniecLinii > p) {
+            analizujLinie(s, p, koniecLinii);
+            s.linie++;
+        }
+        p = koniecLinii + 1;
+    }
+}
+
+void zeruj(tstatystyki &s) {
+    memset(s.kubelki, 0, sizeof(s.kubelki));
+    s.sumaCzasow[0] = s.sumaCzasow[1] = 0;
+    s.liczbaCzasow[0] = s.liczbaCzasow[1] = 0;
+    s.linie = 0;
+    s.nieznane = 0;
+    s.firmy = 0;
+}
+
+void dodajWektor(std::vector<int> &cel, const std::vector<int> &zrodlo) {
+    if (zrodlo.size() > cel.size()) cel.resize(zrodlo.size(), 0);
+    for (size_t i = 0; i < zrodlo.size(); i++) cel[i] += zrodlo[i];
+}
+
+int wartosc(const std::vector<int> &v, int i) {
+    return i < (int) v.size() ? v[i] : 0;
+}
+
+const char * nazwaZasobu[2] = {"klinike", "okienko"};
+
+int main(int argc, char * argv[]) {
+    int K = -1, L = -1;
+    int watki = std::thread::hardware_concurrency();
+    if (watki < 1) watki = 1;
+
+    int opcja;
+    while ((opcja = getopt(argc, argv, "k:l:j:")) != -1) {
+        switch (opcja) {
+        case 'k':
+            K = atoi(optarg);
+            break;
+        case 'l':
+            L = atoi(optarg);
+            break;
+        case 'j':
+            watki = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if (argc - optind != 1) {
+        printf("Uruchomienie: %s [-k K] [-l L] [-j watki] <timeline.txt>\n"
+               "-k, -l- liczba miejsc w klinice i okienek, bez nich nie sprawdzamy przekroczen\n", argv[0]);
+        return -1;
+    }
+
+    int plik = open(argv[optind], O_RDONLY);
+    struct stat info;
+    if (plik < 0 || fstat(plik, &info) < 0) {
+        fprintf(stderr, "Nie mozna otworzyc %s\n", argv[optind]);
+        return 1;
+    }
+    const char * dane = "";
+    size_t rozmiar = info.st_size;
+    if (rozmiar > 0) {
+        dane = (const char *) mmap(NULL, rozmiar, PROT_READ, MAP_PRIVATE, plik, 0);
+        if (dane == MAP_FAILED) {
+            fprintf(stderr, "Nie mozna zmapowac %s\n", argv[optind]);
+            return 1;
+        }
+        madvise((void *) dane, rozmiar, MADV_SEQUENTIAL);
+    }
+
+    // Kawalki konczymy na granicy linii
+    if ((size_t) watki > rozmiar / 65536 + 1) watki = rozmiar / 65536 + 1;
+    std::vector<tkawalek> kawalki(watki);
+    std::vector<tstatystyki> wyniki(watki);
+    const char * p = dane;
+    for (int i = 0; i < watki; i++) {
+        const char * k = i == watki - 1 ? dane + rozmiar : dane + rozmiar / watki * (i + 1);
+        if (k < p) k = p;
+        while (k < dane + rozmiar && k > dane && k[-1] != '\n') k++;
+        kawalki[i].poczatek = p;
+        kawalki[i].koniec = k;
+        kawalki[i].wynik = &wyniki[i];
+        zeruj(wyniki[i]);
+        p = k;
+    }
+
+    std::vector<std::thread> pracownicy;
+    for (int i = 1; i < watki; i++)
+        pracownicy.push_back(std::thread(analizujKawalek, &kawalki[i]));
+    analizujKawalek(&kawalki[0]);
+    for (size_t i = 0; i < pracownicy.size(); i++)
+        pracownicy[i].join();
+
+    // Laczymy wyniki, zajetosc w kolejnosci pliku
+    tstatystyki suma;
+    zeruj(suma);
+    std::vector<int> miejsca[2];
+    int zajete[2] = {0, 0}, najwiecej[2] = {0, 0}, przekroczenia[2] = {0, 0};
+    int limit[2] = {K, L};
+    int linia = 0;
+    for (int i = 0; i < watki; i++) {
+        tstatystyki &s = wyniki[i];
+        for (int z = 0; z < 2; z++) {
+            dodajWektor(suma.przyjete[z], s.przyjete[z]);
+            dodajWektor(suma.wyslaneDo[z], s.wyslaneDo[z]);
+            for (int b = 0; b < LICZBA_KUBELKOW; b++) suma.kubelki[z][b] += s.kubelki[z][b];
+            suma.sumaCzasow[z] += s.sumaCzasow[z];
+            suma.liczbaCzasow[z] += s.liczbaCzasow[z];
+        }
+        dodajWektor(suma.wyjscia, s.wyjscia);
+        if (s.firmy > suma.firmy) suma.firmy = s.firmy;
+        for (size_t j = 0; j < s.zmiany.size(); j++) {
+            tzmiana &c = s.zmiany[j];
+            std::vector<int> &m = miejsca[c.zasob];
+            if (c.id >= (int) m.size()) m.resize(c.id + 1, 0);
+            zajete[c.zasob] += c.miejsca - m[c.id];
+            m[c.id] = c.miejsca;
+            if (zajete[c.zasob] > najwiecej[c.zasob]) najwiecej[c.zasob] = zajete[c.zasob];
+            if (limit[c.zasob] >= 0 && zajete[c.zasob] > limit[c.zasob]) {
+                przekroczenia[c.zasob]++;
+                printf("Linia %d: firma %d zajmuje %s, zajetych jest %d z %d\n", linia + c.linia + 1, c.id,
+                       c.zasob == KLINIKA ? "klinike" : "okienko", zajete[c.zasob], limit[c.zasob]);
+            }
+        }
+        linia += s.linie;
+        suma.linie += s.linie;
+        suma.nieznane += s.nieznane;
+    }
+
+    int firmy = suma.firmy;
+    for (int z = 0; z < 2; z++) {
+        if ((int) suma.przyjete[z].size() > firmy) firmy = suma.przyjete[z].size();
+        if ((int) suma.wyslaneDo[z].size() > firmy) firmy = suma.wyslaneDo[z].size();
+    }
+
+    // Informacja o wyjsciu trafia do wszystkich firm poza nadawca
+    suma.wyslaneDo[KLINIKA].resize(firmy, 0);
+    for (int i = 0; i < (int) suma.wyjscia.size(); i++)
+        for (int j = 0; j < firmy; j++)
+            if (j != i) suma.wyslaneDo[KLINIKA][j] += suma.wyjscia[i];
+
+    printf("Przeanalizowano %d linii (%d nieczytelnych) w %d watkach\n\n", suma.linie, suma.nieznane, watki);
+    printf("Firma | klinika: przyjete wyslane do roznica | okienka: przyjete wyslane do roznica\n");
+    for (int i = 0; i < firmy; i++) {
+        int pk = wartosc(suma.przyjete[KLINIKA], i), wk = wartosc(suma.wyslaneDo[KLINIKA], i);
+        int po = wartosc(suma.przyjete[OKNO], i), wo = wartosc(suma.wyslaneDo[OKNO], i);
+        printf("%5d | %17d %10d %7d | %17d %10d %7d\n", i, pk, wk, pk - wk, po, wo, po - wo);
+    }
+
+    for (int z = 0; z < 2; z++) {
+        printf("\nCzas oczekiwania na %s: %lld dostepow", nazwaZasobu[z], suma.liczbaCzasow[z]);
+        if (suma.liczbaCzasow[z] > 0)
+            printf(", srednio %.3f ms", suma.sumaCzasow[z] / suma.liczbaCzasow[z]);
+        printf("\n");
+        for (int b = 0; b < LICZBA_KUBELKOW; b++) {
+            if (suma.kubelki[z][b] == 0) continue;
+            if (b == 0)
+                printf("%10s < %7d ms: %lld\n", "", 1, suma.kubelki[z][b]);
+            else
+                printf("%7lld ms - %7lld ms: %lld\n", 1LL << (b - 1), 1LL << b, suma.kubelki[z][b]);
+        }
+    }
+
+    printf("\nNajwieksza zajetosc: klinika %d", najwiecej[KLINIKA]);
+    if (K >= 0) printf(" z %d, przekroczen %d", K, przekroczenia[KLINIKA]);
+    printf(", okienka %d", najwiecej[OKNO]);
+    if (L >= 0) printf(" z %d, przekroczen %d", L, przekroczenia[OKNO]);
+    printf("\n");
+
+    if (rozmiar > 0) munmap((void *) dane, rozmiar);
+    close(plik);
+    return przekroczenia[KLINIKA] + przekroczenia[OKNO] > 0 ? 2 : 0;
+}
@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "dziennik.h"
+
+/*
+ * Dekoder dziennikow idiokracji
+ *
+ * Czyta binarne dzienniki firm i wypisuje je w formacie tekstowym, w jakim
+ * idiokracja pisala dawniej na standardowe wyjscie, np.:
+ *
+ *     ./dekoder.out dziennik.*.bin > timeline.txt
+ *
+ * Zapisy wszystkich firm sa scalane wg czasu rzeczywistego, a zapisy jednej
+ * firmy zachowuja kolejnosc z dziennika.
+ *
+*/
+
+struct twczesniejszyZapis {
+    bool operator()(const tzapis &a, const tzapis &b) const {
+        return a.czas < b.czas;
+    }
+};
+
+// Wczytuje wszystkie zapisy z jednego dziennika, zwraca czy dziennik jest poprawny
+bool wczytaj(const char * nazwa, std::vector<tzapis> &zapisy) {
+    FILE * plik = fopen(nazwa, "rb");
+    if (plik == NULL) {
+        fprintf(stderr, "Nie mozna otworzyc %s\n", nazwa);
+        return false;
+    }
+    tnaglowekDziennika naglowek;
+    if (fread(&naglowek, sizeof(naglowek), 1, plik) != 1 || memcmp(naglowek.magia, "IDZD", 4) != 0) {
+        fprintf(stderr, "%s nie jest dziennikiem idiokracji\n", nazwa);
+        fclose(plik);
+        return false;
+    }
+    if (naglowek.wersja != WERSJA_DZIENNIKA) {
+        fprintf(stderr, "%s ma dziennik w wersji %d, a dekoder zna wersje %d\n", nazwa, naglowek.wersja, WERSJA_DZIENNIKA);
+        fclose(plik);
+        return false;
+    }
+    tzapis zapis;
+    while (fread(&zapis, sizeof(zapis), 1, plik) == 1) // Niepelny ostatni zapis pomijamy
+        zapisy.push_back(zapis);
+    fclose(plik);
+    return true;
+}
+
+// Wypisuje zapis w formacie dawnego komunikatu
+void wypisz(const tzapis &z) {
+    if (z.zdarzenie >= LICZBA_ZDARZEN) {
+        printf("%d %d : Firma <%d> nieznane zdarzenie %d\n", z.lamport, z.id, z.id, z.zdarzenie);
+        return;
+    }
+    printf("%d %d : Firma <%d> ", z.lamport, z.id, z.id);
+    int v = 0;
+    for (const char * c = formatZdarzenia[z.zdarzenie]; *c; c++) {
+        if (*c != '%') {
+            putchar(*c);
+            continue;
+        }
+        c++;
+        switch (*c) {
+        case 'd':
+            printf("%d", z.val[v++]);
+            break;
+        case 'm':
+            printf("%.3f", z.val[v++] / 1000.0);
+            break;
+        case 'z':
+            fputs(z.val[v++] == 0 ? "klinike" : "okienko", stdout);
+            break;
+        case 'b':
+            fputs(z.val[v++] ? "blokujacym" : "nieblokujacym", stdout);
+            break;
+        case 's':
+            fputs(z.stan < LICZBA_STANOW ? opisStanu[z.stan] : "?", stdout);
+            break;
+        case 'n':
+            fputs(z.tag < LICZBA_TAGOW ? nazwaTagu[z.tag] : "?", stdout);
+            break;
+        default:
+            putchar(*c);
+        }
+    }
+    putchar('\n');
+}
+
+int main(int argc, char * argv[]) {
+    if (argc < 2) {
+        printf("Uruchomienie: %s <dziennik.bin>...\n", argv[0]);
+        return -1;
+    }
+
+    std::vector<tzapis> zapisy;
+    for (int i = 1; i < argc; i++)
+        if (!wczytaj(argv[i], zapisy))
+            return 1;
+
+    std::stable_sort(zapisy.begin(), zapisy.end(), twczesniejszyZapis());
+    for (size_t i = 0; i < zapisy.size(); i++)
+        wypisz(zapisy[i]);
+    return 0;
+}
@@ -0,0 +1,526 @@
+#include "distributed_mutex.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// Sent by application threads to the communication thread of their leader,
+// which is their own one unless the service is hierarchical
+#define LOCK_TAG		101
+#define UNLOCK_TAG		102
+#define CANCEL_TAG		103 // try_lock_for gave up waiting
+// Sent between communication threads
+#define REQUEST_TAG		104
+#define AGREE_TAG		105
+#define DONE_TAG		106 // sender will not request again
+#define GRANT_TAG		107 // leader to the process that asked it for the lock
+
+// Every message is {lamport, lock id, request sequence number}
+#define MESSAGE_INTS	3
+
+// Locks a node can use at once, each takes one slot of the shared table
+#define NODE_SLOTS		64
+#define NODE_SLOT_FREE	-1
+
+using namespace std;
+
+enum Phase {
+    IDLE,
+    WANTED,     // requests sent, waiting for agreements
+    HELD,
+    ABANDONED   // request cancelled, released as soon as all agreements arrive
+};
+
+struct LockState {
+    int id;
+    string name;    // empty until created locally, remote requests create it too
+
+    // Communication thread of the leader only
+    Phase phase;
+    int seq;        // request being served, tells stale unlock and cancel apart
+    int requester;  // process of the node that asked for it
+    int ended;      // last request unlocked or cancelled, seqs of a node go up by one
+    map<int, int> early;    // seq to requester, came before the end of the request they follow
+    set<int> cancelled;     // early requests cancelled before they started
+    int request_clock;
+    int replies;
+    set<int> deferred;
+
+    // Handoff to the application thread, also the futex word
+    atomic<int> granted;    // seq of the last request granted to this process
+};
+
+// Queue of the node's threads for one lock, a ticket lock in the shared window.
+// The plain fields belong to the thread at the head of the queue
+struct NodeSlot {
+    atomic<int> id;             // NODE_SLOT_FREE until a lock claims it
+    atomic<int> next_ticket;
+    atomic<int> now_serving;    // futex word for the waiters of the node
+    atomic<int> sleepers;       // try_lock_for callers parked without a ticket
+    int next_seq;               // unique in the node, the leader tells requests apart by it
+    int global;                 // held globally on behalf of the node
+    int passes;                 // handoffs since the global acquisition
+    int padding[9];             // one slot per cache line
+};
+
+static_assert(sizeof(atomic<int>) == sizeof(int), "futex needs a plain int word");
+
+
+// Same name gives the same id in every process
+static int lock_id(const string &name)
+{
+    unsigned hash = 2166136261u;
+    for (size_t i = 0; i < name.size(); i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return (int)(hash & 0x7fffffff);
+}
+
+// Not FUTEX_PRIVATE_FLAG, the ticket words are shared between processes
+static void futex_wait(atomic<int> *word, int expected, const struct timespec *timeout)
+{
+    syscall(SYS_futex, (int *)word, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+
+static void futex_wake(atomic<int> *word)
+{
+    syscall(SYS_futex, (int *)word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Parks while the word still holds current, false once the deadline passed
+static bool park(atomic<int> *word, int current, const chrono::steady_clock::time_point *deadline)
+{
+    if (deadline == NULL) {
+        futex_wait(word, current, NULL);
+        return true;
+    }
+    chrono::nanoseconds left = *deadline - chrono::steady_clock::now();
+    if (left.count() <= 0) {
+        return false;
+    }
+    struct timespec timeout;
+    timeout.tv_sec = left.count() / 1000000000;
+    timeout.tv_nsec = left.count() % 1000000000;
+    futex_wait(word, current, &timeout);
+    return true;
+}
+
+// Spins, then parks until the word holds value or the deadline passes.
+// The acquire load pairs with the release store of the value, so the waiter
+// sees everything the previous holder did before its unlock.
+static bool await(atomic<int> *word, int value, int spin, const chrono::steady_clock::time_point *deadline)
+{
+    for (int i = 0; i < spin; i++) {
+        if (word->load(memory_order_acquire) == value) {
+            return true;
+        }
+        cpu_relax();
+    }
+    while (true) {
+        int current = word->load(memory_order_acquire);
+        if (current == value) {
+            return true;
+        }
+        if (!park(word, current, deadline)) {
+            return false;
+        }
+    }
+}
+
+
+// SERVICE
+
+MutexService::MutexService(const MPI::Intracomm &parent, int spin, bool hierarchical)
+    : spin(spin), lamport(0), sent_(0), sent_off_node_(0)
+{
+    if (MPI::Query_thread() != MPI::THREAD_MULTIPLE) {
+        fprintf(stderr, "MutexService: MPI must be initialized with MPI_THREAD_MULTIPLE\n");
+        MPI::COMM_WORLD.Abort(1);
+    }
+    comm = parent.Dup();
+    rank_ = comm.Get_rank();
+    size_ = comm.Get_size();
+    stopped = false;
+
+    // The C++ bindings predate MPI-3, so the node and its window use the C API
+    if (hierarchical) {
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank_, MPI_INFO_NULL, &node);
+    } else {
+        MPI_Comm_split(comm, rank_, 0, &node);
+    }
+    int node_rank;
+    MPI_Comm_rank(node, &node_rank);
+    leader_ = rank_;
+    MPI_Bcast(&leader_, 1, MPI_INT, 0, node);
+    node_of.resize(size_);
+    MPI_Allgather(&leader_, 1, MPI_INT, &node_of[0], 1, MPI_INT, comm);
+    for (int i = 0; i < size_; i++) {
+        if (node_of[i] == i) {
+            leaders.push_back(i);
+        }
+    }
+
+    MPI_Aint table_size = node_rank == 0 ? NODE_SLOTS * sizeof(NodeSlot) : 0;
+    void *base;
+    MPI_Win_allocate_shared(table_size, sizeof(NodeSlot), MPI_INFO_NULL, node, &base, &window);
+    MPI_Aint size;
+    int unit;
+    MPI_Win_shared_query(window, 0, &size, &unit, &base);
+    table = (NodeSlot *)base;
+    if (node_rank == 0) {
+        for (int i = 0; i < NODE_SLOTS; i++) {
+            table[i].id = NODE_SLOT_FREE;
+            table[i].next_ticket = 0;
+            table[i].now_serving = 0;
+            table[i].sleepers = 0;
+            table[i].next_seq = 0;
+            table[i].global = 0;
+            table[i].passes = 0;
+        }
+    }
+    MPI_Barrier(node);
+
+    thread = std::thread(&MutexService::run, this);
+}
+
+MutexService::~MutexService()
+{
+    shutdown();
+    for (auto &entry : locks) {
+        delete entry.second;
+    }
+}
+
+void MutexService::shutdown()
+{
+    if (stopped) {
+        return;
+    }
+    post(DONE_TAG, 0, 0, rank_);
+    thread.join();
+    MPI_Win_free(&window);
+    MPI_Comm_free(&node);
+    comm.Free();
+    stopped = true;
+}
+
+LockState *MutexService::find(int id, const char *name)
+{
+    lock_guard<mutex> lck(locks_mtx);
+    LockState *&lock = locks[id];
+    if (lock == NULL) {
+        lock = new LockState();
+        lock->id = id;
+        lock->phase = IDLE;
+        lock->seq = 0;
+        lock->requester = rank_;
+        lock->ended = 0;
+        lock->request_clock = 0;
+        lock->replies = 0;
+        lock->granted = 0;
+    }
+    if (name != NULL) {
+        if (lock->name.empty()) {
+            lock->name = name;
+        } else if (lock->name != name) {
+            fprintf(stderr, "MutexService: locks \"%s\" and \"%s\" have the same id\n", lock->name.c_str(), name);
+            comm.Abort(1);
+        }
+    }
+    return lock;
+}
+
+// Claims the lock's slot in the node table, processes of the node may race for it
+NodeSlot *MutexService::slot(int id)
+{
+    for (int i = 0; i < NODE_SLOTS; i++) {
+        NodeSlot *s = &table[(id + i) % NODE_SLOTS];
+        int expected = NODE_SLOT_FREE;
+        if (s->id.compare_exchange_strong(expected, id) || expected == id) {
+            return s;
+        }
+    }
+    fprintf(stderr, "MutexService: more than %d locks on one node\n", NODE_SLOTS);
+    comm.Abort(1);
+    return NULL;
+}
+
+// Lamport receive rule, only the communication thread writes the clock
+void MutexService::tick(int seen)
+{
+    lamport.store(max(lamport.load(memory_order_relaxed), seen) + 1, memory_order_relaxed);
+}
+
+// Messages from application threads carry no clock
+void MutexService::post(int tag, int id, int seq, int dest)
+{
+    int msg[MESSAGE_INTS] = {0, id, seq};
+    comm.Send(msg, MESSAGE_INTS, MPI::INT, dest, tag);
+}
+
+void MutexService::send(int *msg, int dest, int tag)
+{
+    comm.Send(msg, MESSAGE_INTS, MPI::INT, dest, tag);
+    sent_.store(sent_.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    if (node_of[dest] != leader_) {
+        sent_off_node_.store(sent_off_node_.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+}
+
+// The node queue lets one process of the node ask at a time, so the leader
+// serves at most one requester per lock
+void MutexService::request(LockState *lock, int seq, int requester)
+{
+    lock->seq = seq;
+    lock->requester = requester;
+    if (lock->phase == ABANDONED) {
+        // The cancelled request is still collecting agreements, reuse it
+        lock->phase = WANTED;
+        return;
+    }
+    lock->phase = WANTED;
+    lock->replies = 0;
+    tick(0);
+    lock->request_clock = lamport.load(memory_order_relaxed);
+    int msg[MESSAGE_INTS] = {lock->request_clock, lock->id, 0};
+    for (int i : leaders) {
+        if (i != rank_) {
+            send(msg, i, REQUEST_TAG);
+        }
+    }
+    if (leaders.size() == 1) {
+        grant(lock);
+    }
+}
+
+// Processes of the node send LOCK and the end of the previous request
+// independently, so a LOCK may overtake the UNLOCK it follows, and several
+// try_lock_for timeouts may queue more LOCKs behind it. They wait in early
+// until the request before them ends, cancelled ones are skipped over
+void MutexService::finish(LockState *lock, int seq)
+{
+    lock->ended = seq;
+    while (lock->cancelled.erase(lock->ended + 1) == 1) {
+        lock->ended++;
+    }
+    auto next = lock->early.find(lock->ended + 1);
+    if (next != lock->early.end()) {
+        int requester = next->second;
+        lock->early.erase(next);
+        request(lock, lock->ended + 1, requester);
+    }
+}
+
+void MutexService::grant(LockState *lock)
+{
+    lock->phase = HELD;
+    if (lock->requester == rank_) {
+        deliver(lock, lock->seq);
+    } else {
+        int msg[MESSAGE_INTS] = {lamport.load(memory_order_relaxed), lock->id, lock->seq};
+        send(msg, lock->requester, GRANT_TAG);
+    }
+}
+
+void MutexService::deliver(LockState *lock, int seq)
+{
+    lock->granted.store(seq, memory_order_release);
+    futex_wake(&lock->granted);
+}
+
+void MutexService::release(LockState *lock)
+{
+    lock->phase = IDLE;
+    tick(0);
+    int msg[MESSAGE_INTS] = {lamport.load(memory_order_relaxed), lock->id, 0};
+    for (int p : lock->deferred) {
+        send(msg, p, AGREE_TAG);
+    }
+    lock->deferred.clear();
+}
+
+// Communication thread. It keeps answering requests until every process,
+// including this one, has sent DONE_TAG. Messages between two processes are
+// not overtaken, so no request can follow a DONE_TAG from the same sender.
+void MutexService::run()
+{
+    int msg[MESSAGE_INTS];
+    MPI::Status status;
+    int done = 0;
+
+    while (done < size_) {
+        comm.Recv(msg, MESSAGE_INTS, MPI::INT, MPI::ANY_SOURCE, MPI::ANY_TAG, status);
+        tick(msg[0]);
+        int source = status.Get_source();
+        int tag = status.Get_tag();
+
+        if (tag == DONE_TAG) {
+            if (source == rank_) {
+                int reply[MESSAGE_INTS] = {lamport.load(memory_order_relaxed), 0, 0};
+                for (int i = 0; i < size_; i++) {
+                    if (i != rank_) {
+                        send(reply, i, DONE_TAG);
+                    }
+                }
+            }
+            done++;
+            continue;
+        }
+
+        LockState *lock = find(msg[1], NULL);
+        switch (tag) {
+            case LOCK_TAG:
+                if (lock->ended == msg[2] - 1) {
+                    request(lock, msg[2], source);
+                } else {
+                    lock->early[msg[2]] = source;
+                }
+                break;
+            case UNLOCK_TAG:
+                if (lock->phase == HELD && lock->seq == msg[2]) {
+                    release(lock);
+                    finish(lock, msg[2]);
+                }
+                break;
+            case CANCEL_TAG:
+                // The grant may have raced with the timeout, then it is released here.
+                // A process sends CANCEL after its LOCK, so an unstarted request is in early
+                if (lock->early.erase(msg[2]) == 1) {
+                    lock->cancelled.insert(msg[2]);
+                    break;
+                }
+                if (lock->seq != msg[2]) {
+                    break;
+                }
+                if (lock->phase == HELD) {
+                    release(lock);
+                } else if (lock->phase == WANTED) {
+                    lock->phase = ABANDONED;
+                }
+                finish(lock, msg[2]);
+                break;
+            case GRANT_TAG:
+                deliver(lock, msg[2]);
+                break;
+            case REQUEST_TAG: {
+                bool competing = lock->phase == WANTED || lock->phase == ABANDONED;
+                if (lock->phase == HELD || (competing && (lock->request_clock < msg[0] ||
+                        (lock->request_clock == msg[0] && rank_ < source)))) {
+                    // current process has higher priority
+                    lock->deferred.insert(source);
+                } else {
+                    int reply[MESSAGE_INTS] = {lamport.load(memory_order_relaxed), lock->id, 0};
+                    send(reply, source, AGREE_TAG);
+                }
+                break;
+            }
+            case AGREE_TAG:
+                // Only a request in progress is ever agreed to
+                if (++lock->replies == (int)leaders.size() - 1) {
+                    if (lock->phase == WANTED) {
+                        grant(lock);
+                    } else {
+                        release(lock);
+                    }
+                }
+                break;
+            default:
+                fprintf(stderr, "MutexService: unknown message tag %d\n", tag);
+        }
+    }
+}
+
+
+// MUTEX
+
+DistributedMutex::DistributedMutex(MutexService &service, const string &name, int handoff)
+    : service(service), handoff(handoff)
+{
+    int id = lock_id(name);
+    state = service.find(id, name.c_str());
+    slot = service.slot(id);
+}
+
+// Called at the head of the node queue
+bool DistributedMutex::acquire(const time_point *deadline)
+{
+    int seq = ++slot->next_seq;
+    service.post(LOCK_TAG, state->id, seq, service.leader_);
+    if (!await(&state->granted, seq, service.spin, deadline)) {
+        service.post(CANCEL_TAG, state->id, seq, service.leader_);
+        return false;
+    }
+    slot->global = 1;
+    slot->passes = 0;
+    return true;
+}
+
+// Moves the node queue on, ticket is the one being served
+void DistributedMutex::leave(int ticket)
+{
+    slot->now_serving.store(ticket + 1);
+    if (slot->next_ticket.load() != ticket + 1 || slot->sleepers.load() != 0) {
+        futex_wake(&slot->now_serving);
+    }
+}
+
+void DistributedMutex::lock()
+{
+    int ticket = slot->next_ticket.fetch_add(1);
+    await(&slot->now_serving, ticket, service.spin, NULL);
+    if (!slot->global) {
+        acquire(NULL);
+    }
+}
+
+// The leader releases by seq alone, so any process of the node may send it
+void DistributedMutex::unlock()
+{
+    int ticket = slot->now_serving.load(memory_order_relaxed);
+    bool waiting = slot->next_ticket.load() != ticket + 1;
+    if (waiting && slot->passes < handoff) {
+        slot->passes++;
+    } else {
+        slot->global = 0;
+        service.post(UNLOCK_TAG, state->id, slot->next_seq, service.leader_);
+    }
+    leave(ticket);
+}
+
+bool DistributedMutex::try_lock_for(chrono::milliseconds timeout)
+{
+    time_point deadline = chrono::steady_clock::now() + timeout;
+    int ticket;
+    while (true) {
+        // Takes a ticket only when it would be served at once
+        ticket = slot->now_serving.load(memory_order_acquire);
+        int expected = ticket;
+        if (slot->next_ticket.compare_exchange_strong(expected, ticket + 1)) {
+            break;
+        }
+        slot->sleepers.fetch_add(1);
+        bool early = park(&slot->now_serving, ticket, &deadline);
+        slot->sleepers.fetch_sub(1);
+        if (!early) {
+            return false;
+        }
+    }
+    if (slot->global || acquire(&deadline)) {
+        return true;
+    }
+    leave(ticket);
+    return false;
+}
@@ -0,0 +1,138 @@
+#ifndef DISTRIBUTED_MUTEX_H
+#define DISTRIBUTED_MUTEX_H
+
+#include <mpi.h>
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <string>
+
+/*
+ * Distributed mutual exclusion for MPI worker processes
+ *
+ * One MutexService per process owns a duplicate of the given communicator
+ * and one communication thread. Any number of named DistributedMutex objects
+ * share that thread; each name is an independent Ricart-Agrawala lock, and
+ * processes that refer to the same name compete for the same lock:
+ *
+ *     MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+ *     MutexService service(MPI::COMM_WORLD);
+ *     DistributedMutex printer(service, "printer");
+ *     printer.lock();
+ *     ...
+ *     printer.unlock();
+ *     service.shutdown(); // collective, before MPI::Finalize
+ *
+ * Every process of the communicator must create the service and call
+ * shutdown(), even if it never takes a lock, because requests are answered
+ * by the communication thread of every peer.
+ *
+ * Any number of threads of a process may use the same lock. They queue
+ * locally on a ticket lock first, and only the thread at the head of that
+ * queue asks the other processes, so a process sends one round of messages
+ * per global acquisition however many of its threads wait. With handoff > 0
+ * a thread leaving the lock passes it straight to the next local waiter, up
+ * to handoff times in a row, before it is released to the other processes.
+ *
+ * In the hierarchical mode the processes of one node share that ticket lock
+ * through an MPI shared memory window, so all threads of the node queue on
+ * it. The lowest rank of each node is its leader, and only leaders run the
+ * Ricart-Agrawala protocol with each other on behalf of their nodes. The head
+ * of a node's queue asks its leader for the lock, and the leader forwards the
+ * grant. Messages between nodes then grow with the number of nodes, not with
+ * the number of processes.
+ *
+ * A grant is handed to the waiting thread through an atomic word: the thread
+ * spins on it for the given number of iterations and then parks on a futex
+ * until the communication thread stores the grant and wakes it. Spinning
+ * pays off for short critical sections when the waiter has a core to itself.
+ *
+*/
+
+struct LockState;
+struct NodeSlot;
+
+class MutexService {
+public:
+    // Starts the communication thread, requires MPI_THREAD_MULTIPLE,
+    // spin is how many times a waiter polls its grant before parking,
+    // hierarchical groups the processes by node (MPI_COMM_TYPE_SHARED)
+    explicit MutexService(const MPI::Intracomm &comm, int spin = 0, bool hierarchical = false);
+    ~MutexService();
+
+    // Tells every peer that this process will not request again and waits
+    // until all of them have said the same, must not hold or wait for a lock
+    void shutdown();
+
+    int rank() const { return rank_; }
+    int size() const { return size_; }
+    int clock() const { return lamport.load(std::memory_order_relaxed); }
+    int leader() const { return leader_; }
+    int nodes() const { return (int)leaders.size(); }
+    // Requests, agreements, grants and DONE sent to other processes so far,
+    // and the part of them sent to other nodes
+    long sent() const { return sent_.load(std::memory_order_relaxed); }
+    long sent_off_node() const { return sent_off_node_.load(std::memory_order_relaxed); }
+
+private:
+    friend class DistributedMutex;
+
+    LockState *find(int id, const char *name);
+    NodeSlot *slot(int id);
+    void post(int tag, int id, int seq, int dest);
+    void run();
+    void request(LockState *lock, int seq, int requester);
+    void release(LockState *lock);
+    void grant(LockState *lock);
+    void finish(LockState *lock, int seq);
+    void deliver(LockState *lock, int seq);
+    void tick(int seen);
+    void send(int *msg, int dest, int tag);
+
+    MPI::Intracomm comm;
+    int rank_, size_;
+    int spin;
+    MPI_Comm node;            // processes sharing the ticket locks, only this one when flat
+    MPI_Win window;           // the node's table of NodeSlot
+    NodeSlot *table;
+    int leader_;              // rank that competes for this node
+    std::vector<int> leaders; // one rank per node
+    std::vector<int> node_of; // leader of every rank
+    std::atomic<int> lamport; // written by the communication thread only
+    std::atomic<long> sent_;  // written by the communication thread only
+    std::atomic<long> sent_off_node_;
+    std::mutex locks_mtx;     // guards locks, which application threads extend
+    std::map<int, LockState *> locks;
+    std::thread thread;
+    bool stopped;
+};
+
+class DistributedMutex {
+public:
+    // handoff is how many times in a row the lock may pass between threads
+    // of the node before it goes back to the other nodes
+    DistributedMutex(MutexService &service, const std::string &name, int handoff = 0);
+
+    void lock();
+    void unlock();
+    // Gives up the request if it was not granted in time. The local queue is
+    // not joined but retried, so try_lock_for waiters are not served in order
+    bool try_lock_for(std::chrono::milliseconds timeout);
+
+private:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    bool acquire(const time_point *deadline);
+    void leave(int ticket);
+
+    MutexService &service;
+    LockState *state;   // grants for this process
+    NodeSlot *slot;     // queue of the node
+    int handoff;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef DZIENNIK_H
+#define DZIENNIK_H
+
+#include "protokol.h"
+
+/*
+ * Binarny dziennik zdarzen idiokracji
+ *
+ * Zamiast formatowac komunikat przy kazdym zdarzeniu, silnik zapisuje
+ * zapis stalej dlugosci, a tekst powstaje dopiero w dekoderze. Plik dziennika
+ * to naglowek, a po nim zapisy w kolejnosci ich powstania.
+ *
+ * Tresc komunikatu opisuje format z tablicy formatZdarzenia, w ktorym
+ * %d to kolejna wartosc zapisu, %m to kolejna wartosc w mikrosekundach
+ * wypisana w milisekundach, %z to kolejna wartosc jako nazwa zasobu,
+ * %b to kolejna wartosc jako rodzaj rozsylania, %s to opis stanu firmy,
+ * a %n to nazwa tagu zapisu.
+ *
+*/
+
+// Poziomy dziennika, zdarzenia powyzej DZIENNIK_POZIOM nie sa kompilowane
+#define POZIOM_BRAK        0
+#define POZIOM_DOSTEP      1 // Ubieganie sie o zasoby, wejscia i wyjscia
+#define POZIOM_WIADOMOSCI  2 // Dodatkowo obsluga kazdej odebranej wiadomosci
+#ifndef DZIENNIK_POZIOM
+#define DZIENNIK_POZIOM    POZIOM_WIADOMOSCI
+#endif
+
+#define WERSJA_DZIENNIKA   1
+
+typedef struct {
+    char magia[4];   // "IDZD"
+    int wersja;      // WERSJA_DZIENNIKA
+    int id;          // Firma, ktora zapisala dziennik
+    int N;           // Liczba firm
+} tnaglowekDziennika;
+
+typedef struct {
+    double czas;             // Czas rzeczywisty w sekundach, wspolny dla firm na jednym wezle
+    int lamport;
+    int id;
+    unsigned char stan;
+    unsigned char zdarzenie; // Indeks w tablicy formatZdarzenia
+    unsigned char tag;       // Tag wiadomosci, ktorej dotyczy zdarzenie
+    unsigned char zapas;
+    int peer;                // Druga firma, ktorej dotyczy zdarzenie, -1 gdy brak
+    int val[4];              // Wartosci w kolejnosci wg formatu zdarzenia
+} tzapis;
+
+enum {
+    ZD_CZEKALA,
+    ZD_IDIOCI,
+    ZD_DOSTEP_KLINIKA,
+    ZD_BROADCAST,
+    ZD_OTRZYMALA,
+    ZD_PIERWSZENSTWO,
+    ZD_BEZ_PIERWSZENSTWA,
+    ZD_ZGODY,
+    ZD_USUWA,
+    ZD_WYSYLA_ZAJETYCH,
+    ZD_BRAK_MIEJSCA,
+    ZD_ZGODA_SKOLEJKOWANEMU,
+    ZD_WYJSCIE,
+    ZD_WESZLA_ZGODA,
+    ZD_WYSYLA,
+    ZD_ZWALNIAJACA,
+    ZD_ZWOLNIENIE_MIEJSC,
+    ZD_ZOSTAJE,
+    ZD_DOSTEP_OKNO,
+    ZD_KOLEJKUJE,
+    ZD_PAPIERKOLOGIA,
+    ZD_OPUSZCZA_ZGODA,
+    ZD_ZGODY_ROZESLANE,
+    ZD_KWORUM_REQUEST,
+    ZD_KWORUM_CZEKA,
+    ZD_WYJSCIE_RZAD,
+    ZD_OKNO_RZAD,
+    ZD_WOLNY_ZETON,
+    ZD_ZETON_REQUEST,
+    ZD_PRZEKAZUJE_ZETON,
+    ZD_OTRZYMALA_ZETON,
+    ZD_ODDAJE_ZETON,
+    ZD_ZATRZYMUJE_ZETON,
+    ZD_ZLY_PAKIET,
+    ZD_LICZNIK_ZAJELA,
+    ZD_LICZNIK_CZEKA,
+    ZD_LICZNIK_WPUSZCZA,
+    ZD_LICZNIK_ODDAJE,
+    LICZBA_ZDARZEN
+};
+
+// Tresci komunikatow po "<lamport> <id> : Firma <id> "
+static const char * formatZdarzenia[LICZBA_ZDARZEN] = {
+    "czekala na %z %m ms, srednio %m ms przy rozsylaniu %b",
+    "otrzymala %d idiotow",
+    "widzi %d miejsc zajetych, otrzymala dostep do kliniki z %d idiotami, przetworzymy ich %d",
+    "wyslala broadcast %n",
+    "%s, otrzymala wiadomosc %n %d %d",
+    "%s, otrzymuje pierwszenstwo przed %d %d",
+    "%s, nie ma pierwszenstwa przed %d %d",
+    "ma juz %d %n",
+    "%s, usuwa z listy obecnych w klinice %d",
+    "%s, jest %d zajetych, wysyla wiadomosc %n do %d %d",
+    "%s, jest %d zajetych, w ktorej nie ma miejsca, wiec nie wysyla AGREE do %d %d",
+    "%s, jest %d zajetych, wysyla zgode do skolejkowanego %d %d",
+    "rozeslala informacje o wyjsciu do pozostalych firm",
+    "weszla do kliniki, wysyla zgode do skolejkowanego %d %d",
+    "%s, wysyla wiadomosc %n do %d %d",
+    "otrzymala wiadomosc %n zwalniajaca miejsce %d %d",
+    "rozeslala informacje o zwolnieniu miejsc, zostaje z %d",
+    "zostaje w klinice z %d idiotami, przetworzymy ich %d",
+    "otrzymala dostep do okienka",
+    "%s, kolejkuje zadanie %d %d",
+    "skonczyla papierkologie",
+    "opuszcza okienko, wysyla zgode do skolejkowanego %d %d",
+    "rozeslala zgody do skolejkowanych firm",
+    "wyslala KWORUM_REQUEST o %z do %d firm z kworum",
+    "widzi %d zajetych z %d, czeka na zwolnienie ze zgodami kworum",
+    "rozeslala informacje o wyjsciu do swojego rzedu",
+    "rozeslala informacje o zwolnieniu okienka do swojego rzedu",
+    "ma wolny zeton %d, otrzymala dostep do okienka",
+    "wyslala OKNO_TOKEN_REQUEST do zarzadcy",
+    "przekazuje wolny zeton %d do %d",
+    "otrzymala zeton %d od %d, otrzymala dostep do okienka",
+    "opuszcza okienko, przekazuje zeton %d do %d",
+    "opuszcza okienko, zatrzymuje zeton %d",
+    "odrzuca pakiet w wersji %d od %d",
+    "zajela od razu %d jednostek, licznik na %z",
+    "czeka w kolejce licznika na %z, potrzebuje %d",
+    "wpuszcza %d z %d jednostkami, licznik na %z",
+    "oddala %d jednostek, licznik na %z"
+};
+
+#endif
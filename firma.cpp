@@ -0,0 +1,1511 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "firma.h"
+
+// POMOCNICZE-------------------------------------------------------------------
+
+int miejscaZajete(tfirma &f) {
+    return f.klinikainside.suma;
+}
+
+// Zapamietuje, ze firma pid zajmuje val jednostek
+void zajmij(tzajetosc &z, int pid, int val) {
+    if (z.obecna[pid]) z.suma -= z.miejsca[pid];
+    z.miejsca[pid] = val;
+    z.obecna[pid] = 1;
+    z.suma += val;
+}
+
+// Usuwa wpis firmy pid, zwraca czy byl
+bool zwolnij(tzajetosc &z, int pid) {
+    if (!z.obecna[pid]) return false;
+    z.suma -= z.miejsca[pid];
+    z.obecna[pid] = 0;
+    return true;
+}
+
+void inicjujZgody(tzgody &z, int N) {
+#ifndef STALE_N
+    z.bity.assign((N + 63) / 64, 0);
+    z.epoki.assign((N + 63) / 64, 0);
+#else
+    memset(z.bity, 0, sizeof(z.bity));
+    memset(z.epoki, 0, sizeof(z.epoki));
+#endif
+    z.epoka = 0;
+}
+
+// Zgody na zadanie zbieramy od nowa przy kazdym ubieganiu sie, wystarczy nowa epoka
+void zbierajZgody(tfirma &f) {
+    tzgody &z = f.agree;
+    if (++z.epoka == 0) { // Po przekreceniu licznika stare epoki moglyby wygladac na biezaca
+        inicjujZgody(z, liczbaFirm(f));
+        z.epoka = 1;
+    }
+}
+
+// Zapamietuje zgode firmy pid, zwraca czy to jej pierwsza zgoda na biezace zadanie
+bool dodajZgode(tzgody &z, int pid) {
+    int w = pid >> 6;
+    unsigned long long bit = 1ULL << (pid & 63);
+    if (z.epoki[w] != z.epoka) { // Slowo z poprzedniego zadania jest puste
+        z.epoki[w] = z.epoka;
+        z.bity[w] = 0;
+    }
+    if (z.bity[w] & bit) return false;
+    z.bity[w] |= bit;
+    return true;
+}
+
+// Liczba zgod na biezace zadanie
+int liczbaZgod(tfirma &f) {
+    const tzgody &z = f.agree;
+    int liczba = 0;
+    for (int w = 0; w < (liczbaFirm(f) + 63) / 64; w++)
+        if (z.epoki[w] == z.epoka) liczba += __builtin_popcountll(z.bity[w]);
+    return liczba;
+}
+
+void inicjujZajetosc(tzajetosc &z, int N) {
+    z.miejsca.assign(N, 0);
+    z.obecna.assign(N, 0);
+    z.suma = 0;
+}
+
+// Dodaje firme wysylajaca wiadomosc do listy obecnych w klinice
+void dodajDoKliniki(tfirma &f, tmessage &message) {
+    zajmij(f.klinikainside, message.pid, message.val);
+}
+
+// Usuwa firme pid z listy obecnych w klinice, zwraca czy byla na liscie
+bool usunZKliniki(tfirma &f, int pid) {
+    return zwolnij(f.klinikainside, pid);
+}
+
+void aktualizujZegar(tfirma &f, tmessage &recvmessage) {
+    int dryf = recvmessage.tim - f.lamport;
+    if (dryf > 0) {
+        tliczniki * l = f.liczniki;
+        if (dryf > l->dryfMax) l->dryfMax = dryf;
+        l->dryfSuma += dryf;
+        l->dryfWiadomosci++;
+    }
+    f.lamport = f.lamport > recvmessage.tim ? f.lamport : recvmessage.tim;
+    f.lamport++;
+}
+
+void wyslij(tfirma &f, int cel, int tag, tmessage &message) {
+    if (cel == f.id) { // Do siebie nie wysylamy przez silnik, obsluzymy to po biezacym zdarzeniu
+        tlokalna lokalna;
+        lokalna.tag = tag;
+        lokalna.message = message;
+        f.doSiebie.push_back(lokalna);
+        return;
+    }
+    if (cel != f.monitor) f.wyslane++;
+    nadaj(f, cel, tag, message);
+}
+
+void rozeslij(tfirma &f, int tag, tmessage &message) {
+    for (int i = 0; i < liczbaFirm(f); i++) { // Wysylamy do kazdego, z wyjatkiem siebie samego
+        if (i != f.id) {
+            wyslij(f, i, tag, message);
+        }
+    }
+}
+
+// Kubelek histogramu opoznien dla czasu w us
+int kubelekOpoznienia(long long us) {
+    if (us < 16) return us < 0 ? 0 : us;
+    int e = 63 - __builtin_clzll(us);
+    int k = 16 + (e - 4) * 16 + (int) ((us >> (e - 4)) & 15);
+    return k < KUBELKI_OPOZNIEN ? k : KUBELKI_OPOZNIEN - 1;
+}
+
+// Najmniejszy czas w us, ktory trafia do kubelka k
+long long dolnaGranicaKubelka(int k) {
+    if (k < 16) return k;
+    return (16LL + (k - 16) % 16) << ((k - 16) / 16);
+}
+
+// Mierzy czas od rozeslania zadania do uzyskania dostepu w biezacym stanie
+void zmierzOczekiwanie(tfirma &f, int z) {
+    double czas = (czasSilnika() - f.czasZadania) * 1000000.0;
+    f.sumaCzasow[f.stan] += czas;
+    f.liczbaDostepow[f.stan]++;
+    f.opoznienia[z][kubelekOpoznienia((long long) czas)]++;
+    DZIENNIK_DOSTEP(f, ZD_CZEKALA, INSIDE, -1, z, (int) (czas + 0.5),
+                    (int) (f.sumaCzasow[f.stan] / f.liczbaDostepow[f.stan] + 0.5), f.rozsylanieBlokujace);
+}
+
+// Tryb monitora: zglasza monitorowi, ile jednostek zasobu zajmujemy od teraz.
+// Zajecie zglaszamy po uzyskaniu dostepu, a zwolnienie przed wyslaniem
+// wiadomosci, ktore pozwalaja wejsc innym, wiec zegary zgloszen zgadzaja sie
+// z przyczynowoscia.
+void zglosMonitorowi(tfirma &f, int tag, int miejsca) {
+    if (f.monitor < 0) return;
+    tmessage zgloszenie;
+    zgloszenie.pid = f.id;
+    zgloszenie.tim = f.lamport;
+    zgloszenie.val = miejsca;
+    wyslij(f, f.monitor, tag, zgloszenie);
+}
+
+void uruchomSterowanie(tfirma &f, int max_wait) {
+    // Czas losuje firma, silnik jedynie go odlicza
+    odliczCzas(f, max_wait > 0 ? rand() % max_wait : 0);
+}
+
+// PRZEJSCIA MIEDZY STANAMI----------------------------------------------------
+
+void wejdzDoStanu1(tfirma &f);
+void wejdzDoStanu2a(tfirma &f);
+void wejdzDoStanu3(tfirma &f);
+
+// STAN 1-----------------------------------------------------------------------
+
+void wejdzDoStanuKoniec(tfirma &f);
+
+void wejdzDoStanu1(tfirma &f) {
+    if (f.zatrzymana || (f.maxRund > 0 && f.rundy >= f.maxRund) || (f.czasKonca > 0 && czasSilnika() >= f.czasKonca)) {
+        wejdzDoStanuKoniec(f);
+        return;
+    }
+    f.rundy++;
+    f.stan = STAN_1;
+    uruchomSterowanie(f, f.czasIdiotow);
+}
+
+// INSIDE w stanie 1- przyszli idioci
+void koniecCzekania(tfirma &f, tmessage &recvmessage, int source) {
+    f.idiots = 0;
+    while (f.idiots == 0) f.idiots = rand() % f.maxIdiotow; // Tutaj przychodza idioci do firmy
+    DZIENNIK_DOSTEP(f, ZD_IDIOCI, INSIDE, -1, f.idiots);
+    wejdzDoStanu2a(f);
+}
+
+// STAN 2a----------------------------------------------------------------------
+
+/*
+ * W tym stanie firma ubiega sie o dostep do kliniki.
+ * Zatem, gdy odbieramy wiadomosc:
+ * -KLINIKA_REQUEST, to porownujemy priorytet i albo uznajemy,ze mamy wiekszy
+ *   i automatycznie uznajemy swoje prawo do sekcji wzgledem tamtego procesu,
+ *   i inkrementujemy licznik zgod
+ *   LUB widzimy, ze mamy mniejszy priorytet i ustepujemy temu procesowi
+ * -KLINIKA_AGREE, to inkrementujemy licznik zgod
+ * -OKNO_REQUEST, to dajemy zgode
+ *
+*/
+
+void wejdzDoStanu2b(tfirma &f);
+void sprawdzSemafor(tfirma &f);
+
+// Sprawdza, czy mamy juz zgody wszystkich firm i mozemy wejsc do kliniki
+void sprawdzDostepDoKliniki(tfirma &f) {
+    if (liczbaZgod(f) < liczbaFirm(f) - 1) return;
+
+    zmierzOczekiwanie(f, ZASOB_KLINIKA);
+
+    f.tmp_idiots = f.idiots;
+
+    // Lista obecnych liczy wszystkich zgloszonych idiotow, wiec zajetych moze byc wiecej niz K
+    int wolne = miejscaKliniki(f) - miejscaZajete(f) > 0 ? miejscaKliniki(f) - miejscaZajete(f) : 0;
+
+    f.idiots = f.idiots - wolne > 0 ? f.idiots - wolne : 0;
+
+    int przetworzymy = f.tmp_idiots < wolne ? f.tmp_idiots : wolne;
+    DZIENNIK_DOSTEP(f, ZD_DOSTEP_KLINIKA, INSIDE, -1, miejscaZajete(f), f.tmp_idiots, przetworzymy);
+    zglosMonitorowi(f, MONITOR_KLINIKA, przetworzymy);
+
+    tmessage request;
+    request.pid = f.id;
+    request.tim = f.lamportonrequest;
+    request.val = f.tmp_idiots;
+    dodajDoKliniki(f, request);
+
+    wejdzDoStanu2b(f);
+}
+
+void kworumUbiegaj(tfirma &f, int z);
+void licznikUbiegaj(tfirma &f, int z);
+bool przezLicznik(tfirma &f, int z);
+
+void wejdzDoStanu2a(tfirma &f) {
+    if (f.trybKliniki == KLINIKA_KWORUM) {
+        f.stan = STAN_2A;
+        f.czasZadania = czasSilnika();
+        kworumUbiegaj(f, ZASOB_KLINIKA);
+        return;
+    }
+    if (przezLicznik(f, ZASOB_KLINIKA)) {
+        f.stan = STAN_2A;
+        f.czasZadania = czasSilnika();
+        licznikUbiegaj(f, ZASOB_KLINIKA);
+        return;
+    }
+
+    f.lamport++;    //Inkrementacja zegara Lamporta przed wyslaniem broadcastu
+
+    tmessage request;
+    request.pid = f.id;      // Nasze id, potrzebne do priorytetu
+    request.tim = f.lamport; // Nasz zegar
+    request.val = f.idiots;  // Ilu idiotow chcemy oddac do badan
+
+    f.lamportonrequest = f.lamport;
+
+    f.czasZadania = czasSilnika();
+    rozeslij(f, KLINIKA_REQUEST, request);
+
+    DZIENNIK_DOSTEP(f, ZD_BROADCAST, KLINIKA_REQUEST, -1);
+
+    zbierajZgody(f);
+
+    f.stan = STAN_2A;
+    if (f.trybKliniki == KLINIKA_SEMAFOR)
+        sprawdzSemafor(f);
+    else
+        sprawdzDostepDoKliniki(f);
+}
+
+// KLINIKA_REQUEST w stanie 2a- ubiegamy sie o sekcje, AGREE zalezy od priorytetu
+void klinikaRequestPriorytet(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, KLINIKA_REQUEST, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    // Nalezy podjac decyzje, kto ma pierwszenstwo do kliniki
+    if ((f.lamportonrequest < recvmessage.tim) || ((f.lamportonrequest == recvmessage.tim) && (f.id < recvmessage.pid))) {
+        // Mam pierwszenstwo do kliniki
+        f.klinikawaiting.push(recvmessage); // Dodaje zatem firme proszaca do listy firm, do ktorych po zakonczeniu wysle ZGODE
+        DZIENNIK_WIADOMOSC(f, ZD_PIERWSZENSTWO, INSIDE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+        if (dodajZgode(f.agree, recvmessage.pid)) { // Jezeli nie otrzymalem dotychczas zgody od tego procesu, to ja zapamietuje
+            DZIENNIK_WIADOMOSC(f, ZD_ZGODY, KLINIKA_AGREE, -1, liczbaZgod(f));
+        }
+    }
+    else {
+        dodajDoKliniki(f, recvmessage);  // W przeciwnym razie on ma pierwszenstwo, wiec zapamietuje go w liscie tych, co sa w klinice
+        DZIENNIK_WIADOMOSC(f, ZD_BEZ_PIERWSZENSTWA, INSIDE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    }
+    aktualizujZegar(f, recvmessage);
+    sprawdzDostepDoKliniki(f);
+}
+
+// KLINIKA_AGREE w stanie 2a- gdy otrzymujemy zgode, to inkrementujemy licznik zgod
+void klinikaAgreeZgoda(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, KLINIKA_AGREE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+    if (recvmessage.val > 0) { //Jezeli ktos zwalnia miejsce w klinice i wysyla nam zgode, to musimy go usunac z naszej listy obecnych w klinice
+        if (usunZKliniki(f, recvmessage.pid))
+            DZIENNIK_WIADOMOSC(f, ZD_USUWA, INSIDE, -1, recvmessage.pid);
+    }
+    if (dodajZgode(f.agree, recvmessage.pid)) {
+        DZIENNIK_WIADOMOSC(f, ZD_ZGODY, KLINIKA_AGREE, -1, liczbaZgod(f));
+    }
+    sprawdzDostepDoKliniki(f);
+}
+
+// STAN 2b----------------------------------------------------------------------
+
+void wejdzDoStanu2b(tfirma &f) {
+    f.stan = STAN_2B;
+    uruchomSterowanie(f, f.czasKliniki);
+}
+
+// KLINIKA_REQUEST w stanie 2b- jestesmy w klinice, zatem najpierw sprawdzamy, czy wg nas jest miejsce w klinice i wtedy wysylamy wiadomosc
+void klinikaRequestWKlinice(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, KLINIKA_REQUEST, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+    if (miejscaZajete(f) < miejscaKliniki(f)) { // Jezeli wiemy, ze sa wolne miejsca w klinice, to wysylamy zgode
+        dodajDoKliniki(f, recvmessage);
+        f.lamport++;
+        tmessage message;
+        message.pid = f.id;
+        message.tim = f.lamport;
+        message.val = 0;
+        wyslij(f, source, KLINIKA_AGREE, message);
+        DZIENNIK_WIADOMOSC(f, ZD_WYSYLA_ZAJETYCH, KLINIKA_AGREE, recvmessage.pid, miejscaZajete(f), recvmessage.tim, recvmessage.pid);
+    }
+    else { // Jezeli nie ma miejsc w klinice, to nie wysylamy zgody do proszacych, tylko zapamietujemy ich w klinika waiting
+        f.klinikawaiting.push(recvmessage);
+        DZIENNIK_WIADOMOSC(f, ZD_BRAK_MIEJSCA, INSIDE, recvmessage.pid, miejscaZajete(f), recvmessage.tim, recvmessage.pid);
+    }
+}
+
+// KLINIKA_AGREE w stanie 2b- gdy otrzymujemy informacje o opuszczeniu przez jedna z firm
+void klinikaAgreeWKlinice(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, KLINIKA_AGREE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+    if (recvmessage.val > 0) { // Jezeli ktos zwalnia miejsce w klinice i wysyla nam zgode, to musimy go usunac z naszej listy obecnych w klinice
+        usunZKliniki(f, recvmessage.pid);
+        if (miejscaZajete(f) < miejscaKliniki(f) && !f.klinikawaiting.empty()) { // Skoro miejsce sie zwolnilo, i mamy jakies miejsce wg nas w klinice, to wysylamy KLINIKA_AGREE do skolejkowanych
+            f.lamport++;
+            // Zgody dostaja najstarsze zadania i tylko tyle z nich, ile zmiesci sie w wolnych miejscach
+            while (!f.klinikawaiting.empty() && miejscaZajete(f) < miejscaKliniki(f)) {
+                tmessage waiting = f.klinikawaiting.top();
+                f.klinikawaiting.pop();
+                tmessage placefree;
+                placefree.pid = f.id;
+                placefree.tim = f.lamport;
+                placefree.val = 0;
+                wyslij(f, waiting.pid, KLINIKA_AGREE, placefree);
+                dodajDoKliniki(f, waiting);
+                DZIENNIK_WIADOMOSC(f, ZD_ZGODA_SKOLEJKOWANEMU, INSIDE, waiting.pid, miejscaZajete(f), waiting.tim, waiting.pid);
+            }
+        }
+    }
+}
+
+// INSIDE w stanie 2b- koniec pobytu w klinice, czyli STAN 2c
+void koniecKliniki(tfirma &f, tmessage &recvmessage, int source) {
+    tmessage leave;
+
+    zglosMonitorowi(f, MONITOR_KLINIKA, 0);
+    f.lamport++;
+    leave.pid = f.id;          // Nasze id, potrzebne do priorytetu
+    leave.tim = f.lamport;     // Nasz zegar
+    leave.val = f.tmp_idiots;  // Wartosc jest konieczna, poniewaz gdy val == 0 to procesy nie usuwaja procesu z listy firm wewnatrz kliniki
+
+    rozeslij(f, KLINIKA_AGREE, leave);
+
+    usunZKliniki(f, f.id);
+
+    while (!f.klinikawaiting.empty()) {
+        tmessage waiting = f.klinikawaiting.top();
+        f.klinikawaiting.pop();
+        dodajDoKliniki(f, waiting);
+    }
+
+    DZIENNIK_DOSTEP(f, ZD_WYJSCIE, INSIDE, -1);
+
+    if (f.idiots > 0)
+        wejdzDoStanu2a(f);
+    else
+        wejdzDoStanu3(f);
+}
+
+// STAN 2 W TRYBIE SEMAFORA WAZONEGO-------------------------------------------
+
+/*
+ * Zadanie KLINIKA_REQUEST niesie liczbe idiotow, a kazda zgoda KLINIKA_AGREE
+ * liczbe miejsc zajmowanych przez jej nadawce. Firma z nizszym priorytetem
+ * odpowiada od razu, firma z wyzszym dopiero po wejsciu do kliniki, wiec po
+ * zebraniu N-1 zgod suma z odpowiedzi obejmuje wszystkich, ktorzy moga byc
+ * w klinice. Firma zajmuje od razu tyle miejsc, ile jest wolnych, a gdy nie
+ * ma zadnego, czeka w stanie 2a na KLINIKA_RELEASE, zachowujac pierwszenstwo.
+ * Zajete miejsca zatrzymuje dla kolejnych partii idiotow i oddaje je przez
+ * KLINIKA_RELEASE dopiero, gdy sa jej niepotrzebne.
+ *
+*/
+
+// Zapamietuje, ile miejsc w klinice zajmuje firma pid
+void ustawTrzymane(tfirma &f, int pid, int miejsca) {
+    if (miejsca > 0) {
+        tmessage message;
+        message.pid = pid;
+        message.tim = 0;
+        message.val = miejsca;
+        dodajDoKliniki(f, message);
+    }
+    else
+        usunZKliniki(f, pid);
+}
+
+// Wysyla zgode z liczba miejsc zajmowanych przez nas
+void zgodaSemafor(tfirma &f, int cel) {
+    f.lamport++;
+    tmessage message;
+    message.pid = f.id;
+    message.tim = f.lamport;
+    message.val = f.trzymane;
+    wyslij(f, cel, KLINIKA_AGREE, message);
+}
+
+// Sprawdza, czy mamy juz wszystkie zgody i czy sa wolne miejsca w klinice
+void sprawdzSemafor(tfirma &f) {
+    if (liczbaZgod(f) < liczbaFirm(f) - 1) return;
+
+    int wolne = miejscaKliniki(f) - miejscaZajete(f);
+    if (wolne <= 0) return; // Czekamy na KLINIKA_RELEASE od firm w klinice
+
+    zmierzOczekiwanie(f, ZASOB_KLINIKA);
+
+    f.tmp_idiots = f.idiots;
+    f.trzymane = f.idiots < wolne ? f.idiots : wolne;
+    f.idiots -= f.trzymane;
+
+    DZIENNIK_DOSTEP(f, ZD_DOSTEP_KLINIKA, INSIDE, -1, miejscaZajete(f), f.tmp_idiots, f.trzymane);
+    zglosMonitorowi(f, MONITOR_KLINIKA, f.trzymane);
+
+    // Odlozonym zadaniom odpowiadamy juz z liczba zajetych przez nas miejsc
+    while (!f.klinikawaiting.empty()) {
+        tmessage waiting = f.klinikawaiting.top();
+        f.klinikawaiting.pop();
+        zgodaSemafor(f, waiting.pid);
+        DZIENNIK_WIADOMOSC(f, ZD_WESZLA_ZGODA, INSIDE, waiting.pid, waiting.tim, waiting.pid);
+    }
+
+    wejdzDoStanu2b(f);
+}
+
+// KLINIKA_REQUEST w stanie 2a- odkladamy zadanie tylko, gdy mamy pierwszenstwo
+void semaforRequestPriorytet(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, KLINIKA_REQUEST, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    if ((f.lamportonrequest < recvmessage.tim) || ((f.lamportonrequest == recvmessage.tim) && (f.id < recvmessage.pid))) {
+        f.klinikawaiting.push(recvmessage); // Odpowiemy po wejsciu do kliniki
+        DZIENNIK_WIADOMOSC(f, ZD_PIERWSZENSTWO, INSIDE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+        aktualizujZegar(f, recvmessage);
+    }
+    else {
+        DZIENNIK_WIADOMOSC(f, ZD_BEZ_PIERWSZENSTWA, INSIDE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+        aktualizujZegar(f, recvmessage);
+        zgodaSemafor(f, source);
+    }
+}
+
+// KLINIKA_REQUEST poza stanem 2a- od razu odpowiadamy z liczba zajetych miejsc
+void semaforRequestZgoda(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, KLINIKA_REQUEST, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+    zgodaSemafor(f, source);
+    DZIENNIK_WIADOMOSC(f, ZD_WYSYLA, KLINIKA_AGREE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+}
+
+// KLINIKA_AGREE w stanie 2a- zapamietujemy miejsca nadawcy i liczymy zgode
+void semaforAgree(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, KLINIKA_AGREE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+    ustawTrzymane(f, recvmessage.pid, recvmessage.val);
+    if (dodajZgode(f.agree, recvmessage.pid)) {
+        DZIENNIK_WIADOMOSC(f, ZD_ZGODY, KLINIKA_AGREE, -1, liczbaZgod(f));
+    }
+    sprawdzSemafor(f);
+}
+
+// KLINIKA_RELEASE- firma oddala czesc lub wszystkie swoje miejsca
+void semaforRelease(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_ZWALNIAJACA, KLINIKA_RELEASE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+    ustawTrzymane(f, recvmessage.pid, recvmessage.val);
+    if (f.stan == STAN_2A)
+        sprawdzSemafor(f);
+}
+
+// INSIDE w stanie 2b- partia idiotow przetworzona, oddajemy zbedne miejsca
+void koniecKlinikiSemafor(tfirma &f, tmessage &recvmessage, int source) {
+    int zostaje = f.idiots < f.trzymane ? f.idiots : f.trzymane;
+
+    if (zostaje < f.trzymane) {
+        f.trzymane = zostaje;
+        zglosMonitorowi(f, MONITOR_KLINIKA, f.trzymane);
+        f.lamport++;
+        tmessage release;
+        release.pid = f.id;
+        release.tim = f.lamport;
+        release.val = f.trzymane;
+        rozeslij(f, KLINIKA_RELEASE, release);
+        DZIENNIK_DOSTEP(f, ZD_ZWOLNIENIE_MIEJSC, INSIDE, -1, f.trzymane);
+    }
+
+    if (f.idiots > 0) {
+        // Kolejna partia bez ponownego ubiegania sie o klinike
+        f.tmp_idiots = f.idiots;
+        f.idiots -= f.trzymane;
+        DZIENNIK_DOSTEP(f, ZD_ZOSTAJE, INSIDE, -1, f.tmp_idiots, f.trzymane);
+        wejdzDoStanu2b(f);
+    }
+    else
+        wejdzDoStanu3(f);
+}
+
+// STAN 3-----------------------------------------------------------------------
+
+void wejdzDoStanu4(tfirma &f);
+
+// Sprawdza, czy mamy juz dosc zgod, aby podejsc do okienka
+void sprawdzDostepDoOkna(tfirma &f) {
+    if (liczbaZgod(f) < liczbaFirm(f) - liczbaOkien(f)) return;
+
+    zmierzOczekiwanie(f, ZASOB_OKNO);
+
+    DZIENNIK_DOSTEP(f, ZD_DOSTEP_OKNO, INSIDE, -1);
+
+    wejdzDoStanu4(f);
+}
+
+void zetonUbiegaj(tfirma &f);
+
+void wejdzDoStanu3(tfirma &f) {
+    if (f.trybOkna == OKNO_ZETON) {
+        f.stan = STAN_3;
+        f.czasZadania = czasSilnika();
+        zetonUbiegaj(f);
+        return;
+    }
+    if (f.trybOkna == OKNO_KWORUM) {
+        f.stan = STAN_3;
+        f.czasZadania = czasSilnika();
+        kworumUbiegaj(f, ZASOB_OKNO);
+        return;
+    }
+    if (przezLicznik(f, ZASOB_OKNO)) {
+        f.stan = STAN_3;
+        f.czasZadania = czasSilnika();
+        licznikUbiegaj(f, ZASOB_OKNO);
+        return;
+    }
+
+    f.lamport++;    //Inkrementacja zegara Lamporta przed wyslaniem broadcastu
+    tmessage request;
+    request.pid = f.id;      // Nasze id, potrzebne do priorytetu
+    request.tim = f.lamport; // Nasz zegar
+    request.val = f.lamport; // Tu dodatkowo zapamietujemy zegar Lamporta przy wyslaniu, zeby uniknac sytuacji
+
+    f.czasZadania = czasSilnika();
+    rozeslij(f, OKNO_REQUEST, request);
+
+    f.lamportonrequest = f.lamport; // Musimy zapamietac zegar Lamporta przy wysylaniu, aby nie uznac przedawnionej zgody
+                                    // z poprzedniego ubiegania sie o sekcje
+
+    DZIENNIK_DOSTEP(f, ZD_BROADCAST, OKNO_REQUEST, -1);
+
+    zbierajZgody(f);
+
+    f.stan = STAN_3;
+    sprawdzDostepDoOkna(f);
+}
+
+// OKNO_REQUEST w stanie 3- ubiegamy sie o sekcje, AGREE zalezy od priorytetu
+void oknoRequestPriorytet(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, OKNO_REQUEST, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    if ((f.lamportonrequest < recvmessage.tim) || ((f.lamportonrequest == recvmessage.tim) && (f.id < recvmessage.pid))) {
+        // Mam pierwszenstwo do okna
+        f.okienkawaiting.push(recvmessage);
+        DZIENNIK_WIADOMOSC(f, ZD_PIERWSZENSTWO, INSIDE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+        if (dodajZgode(f.agree, recvmessage.pid)) {
+            DZIENNIK_WIADOMOSC(f, ZD_ZGODY, OKNO_AGREE, -1, liczbaZgod(f));
+        }
+    }
+    else {
+        DZIENNIK_WIADOMOSC(f, ZD_BEZ_PIERWSZENSTWA, INSIDE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    }
+    aktualizujZegar(f, recvmessage);
+    sprawdzDostepDoOkna(f);
+}
+
+// OKNO_AGREE w stanie 3- gdy otrzymujemy zgode, to inkrementujemy licznik zgod
+void oknoAgreeZgoda(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, OKNO_AGREE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+    if (recvmessage.val == f.lamportonrequest)
+        if (dodajZgode(f.agree, recvmessage.pid)) {
+            DZIENNIK_WIADOMOSC(f, ZD_ZGODY, OKNO_AGREE, -1, liczbaZgod(f));
+        }
+    sprawdzDostepDoOkna(f);
+}
+
+// STAN 4-----------------------------------------------------------------------
+
+void wejdzDoStanu4(tfirma &f) {
+    f.stan = STAN_4;
+    zglosMonitorowi(f, MONITOR_OKNO, 1);
+    uruchomSterowanie(f, f.czasOkna);
+}
+
+// OKNO_REQUEST w stanie 4- jestesmy przy oknie, wiec kolejkujemy zadanie
+void oknoRequestKolejkuj(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, OKNO_REQUEST, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    f.okienkawaiting.push(recvmessage);
+    DZIENNIK_WIADOMOSC(f, ZD_KOLEJKUJE, INSIDE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+}
+
+// INSIDE w stanie 4- koniec papierkologii, czyli STAN 5 zwolnienie okienek
+void koniecPapierkologii(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_DOSTEP(f, ZD_PAPIERKOLOGIA, INSIDE, -1);
+    zglosMonitorowi(f, MONITOR_OKNO, 0);
+
+    f.lamport++;
+    tmessage leave;
+    leave.pid = f.id;      // Nasze id, potrzebne do priorytetu
+    leave.tim = f.lamport; // Nasz zegar
+    leave.val = 0;         // To trzeba dostosowywac do zegaru Lamporta, z jakim byla wysylana nam ta wiadomosc
+
+    while (!f.okienkawaiting.empty()) { // Zgody wysylamy od najstarszego zadania
+        tmessage waiting = f.okienkawaiting.top();
+        f.okienkawaiting.pop();
+        leave.val = waiting.val;
+        wyslij(f, waiting.pid, OKNO_AGREE, leave);
+        DZIENNIK_WIADOMOSC(f, ZD_OPUSZCZA_ZGODA, INSIDE, waiting.pid, waiting.tim, waiting.pid);
+    }
+    DZIENNIK_DOSTEP(f, ZD_ZGODY_ROZESLANE, INSIDE, -1);
+
+    wejdzDoStanu1(f);
+}
+
+// TRYB KWORUM------------------------------------------------------------------
+
+/*
+ * Firmy sa ulozone w siatke o ceil(sqrt(N)) kolumnach, a kworum firmy to jej
+ * rzad i kolumna (kazde dwa kworum maja czesc wspolna). O decyzje o zajeciu
+ * kliniki lub okienka firma ubiega sie algorytmem Maekawy, czyli potrzebuje
+ * zgody tylko od swojego kworum, a zakleszczenia rozwiazuja FAILED, INQUIRE
+ * i YIELD. Firma zglasza liczbe zajetych jednostek zasobu swojemu rzedowi,
+ * a kazda zgoda niesie sume zajetosci rzedu arbitra. Kolumna firmy ma po
+ * jednym czlonku w kazdym rzedzie (dla niepelnego ostatniego rzedu jest to
+ * ostatnia firma), wiec suma z ich zgod to zajetosc calego zasobu. Zmiana
+ * zajetosci trafia do rzedu przed zwolnieniem zgod, wiec kolejna firma
+ * zobaczy ja w zgodach. Jezeli nie ma wolnych jednostek, firma zatrzymuje
+ * zgody, a inne zadania czekaja w kolejkach arbitrow. Zwalniajacy zgloszenie
+ * i tak wysyla swojemu rzedowi, a arbiter z tego rzedu, ktory jest czytelnikiem
+ * czekajacej firmy, przesyla jej nowa zajetosc rzedu w KWORUM_GRANT z ujemna
+ * wartoscia. Przy malym obciazeniu wejscie kosztuje okolo 7 sqrt(N)
+ * wiadomosci, a przy pelnym zasobie dochodzi po jednym GRANT na zwolnienie.
+ *
+*/
+
+int tagKworum(int z, int tag) {
+    return tag + z * KWORUM_TYPY;
+}
+
+int pojemnosc(tfirma &f, int z) {
+    return z == ZASOB_KLINIKA ? miejscaKliniki(f) : liczbaOkien(f);
+}
+
+void kworumWyslij(tfirma &f, int cel, int z, int tag, int val) {
+    tmessage message;
+    message.pid = f.id;
+    message.tim = f.lamport;
+    message.val = val;
+    wyslij(f, cel, tagKworum(z, tag), message);
+}
+
+int kolumnyKworum(tfirma &f) {
+    int kolumn = 1;
+    while (kolumn * kolumn < f.N) kolumn++;
+    return kolumn;
+}
+
+// Czlonek rzedu wiersz w kolumnie firmy pid, dla niepelnego ostatniego rzedu ostatnia firma
+int czytelnikRzedu(tfirma &f, int pid, int wiersz) {
+    int kolumn = kolumnyKworum(f);
+    int j = wiersz * kolumn + pid % kolumn;
+    return j < f.N ? j : f.N - 1;
+}
+
+// Buduje kworum, rzad i czytelnikow firmy w siatce
+void zbudujKworum(tfirma &f) {
+    int kolumn = kolumnyKworum(f);
+    int rzedow = (f.N + kolumn - 1) / kolumn;
+    int wiersz = f.id / kolumn;
+
+    std::set<int> kworum;
+    for (int c = 0; c < kolumn && wiersz * kolumn + c < f.N; c++) {
+        f.rzad.push_back(wiersz * kolumn + c);
+        kworum.insert(wiersz * kolumn + c);
+    }
+    for (int r = 0; r < rzedow; r++) {
+        int j = czytelnikRzedu(f, f.id, r);
+        f.czytelnicy.push_back(j);
+        kworum.insert(j);
+    }
+    f.kworum.assign(kworum.begin(), kworum.end());
+
+    for (int z = 0; z < 2; z++) {
+        tkworum &k = f.zasob[z];
+        k.zablokowany = false;
+        k.zapytany = false;
+        k.odmowiono.assign(f.N, 0);
+        inicjujZajetosc(k.rzad, f.N);
+        k.ubiega = false;
+        k.zgody = 0;
+        k.zgoda.assign(f.N, 0);
+        k.sumaOd.assign(f.N, 0);
+        k.odmowa = false;
+        k.czeka = false;
+        k.trzymane = 0;
+    }
+}
+
+void kworumUbiegaj(tfirma &f, int z) {
+    tkworum &k = f.zasob[z];
+    k.ubiega = true;
+    k.odmowa = false;
+    k.czeka = false;
+    k.zgody = 0;
+    k.zgoda.assign(f.N, 0);
+    k.pytajacy.clear();
+
+    f.lamport++;
+    for (int i = 0; i < f.kworum.size(); i++)
+        kworumWyslij(f, f.kworum[i], z, KWORUM_REQUEST, 0);
+
+    DZIENNIK_DOSTEP(f, ZD_KWORUM_REQUEST, INSIDE, -1, z, (int) f.kworum.size());
+}
+
+// Arbiter udziela zgody, dolaczajac zajetosc swojego rzedu
+void kworumUdziel(tfirma &f, int z, const tmessage &zadanie) {
+    tkworum &k = f.zasob[z];
+    k.zablokowany = true;
+    k.blokada = zadanie;
+    k.zapytany = false;
+    k.odmowiono[zadanie.pid] = 0;
+    f.lamport++;
+    kworumWyslij(f, zadanie.pid, z, KWORUM_GRANT, k.rzad.suma);
+}
+
+void kworumOdmow(tfirma &f, int z, int pid) {
+    f.zasob[z].odmowiono[pid] = 1;
+    f.lamport++;
+    kworumWyslij(f, pid, z, KWORUM_FAILED, 0);
+}
+
+// Oddajemy zgody arbitrom, ktorzy o nie pytali
+void kworumOddaj(tfirma &f, int z) {
+    tkworum &k = f.zasob[z];
+    for (int i = 0; i < k.pytajacy.size(); i++) {
+        int p = k.pytajacy[i];
+        if (!k.zgoda[p]) continue;
+        k.zgoda[p] = 0;
+        k.zgody--;
+        f.lamport++;
+        kworumWyslij(f, p, z, KWORUM_YIELD, 0);
+    }
+    k.pytajacy.clear();
+}
+
+// Mamy zgody calego kworum, wiec tylko my decydujemy teraz o zajeciu zasobu
+void kworumSekcja(tfirma &f, int z) {
+    tkworum &k = f.zasob[z];
+
+    int zajete = 0;
+    for (int i = 0; i < f.czytelnicy.size(); i++)
+        zajete += f.czytelnicy[i] == f.id ? k.rzad.suma : k.sumaOd[f.czytelnicy[i]];
+    int wolne = pojemnosc(f, z) - zajete;
+    int potrzeba = z == ZASOB_KLINIKA ? f.idiots : 1;
+    k.trzymane = wolne <= 0 ? 0 : (potrzeba < wolne ? potrzeba : wolne);
+
+    if (k.trzymane == 0) { // Zgod nie oddajemy, nowa zajetosc przysla nam czytelnicy
+        if (!k.czeka) DZIENNIK_DOSTEP(f, ZD_KWORUM_CZEKA, INSIDE, -1, zajete, pojemnosc(f, z));
+        k.czeka = true;
+        return;
+    }
+
+    f.lamport++;
+    // Najpierw rzad dowiaduje sie o zajetych jednostkach, potem zwalniamy zgody
+    for (int i = 0; i < f.rzad.size(); i++)
+        kworumWyslij(f, f.rzad[i], z, KWORUM_UPDATE, k.trzymane);
+    for (int i = 0; i < f.kworum.size(); i++)
+        kworumWyslij(f, f.kworum[i], z, KWORUM_RELEASE, 0);
+    k.ubiega = false;
+    k.czeka = false;
+    k.pytajacy.clear();
+
+    if (z == ZASOB_KLINIKA) {
+        zmierzOczekiwanie(f, ZASOB_KLINIKA);
+        f.tmp_idiots = f.idiots;
+        f.idiots -= k.trzymane;
+        DZIENNIK_DOSTEP(f, ZD_DOSTEP_KLINIKA, INSIDE, -1, zajete, f.tmp_idiots, k.trzymane);
+        zglosMonitorowi(f, MONITOR_KLINIKA, k.trzymane);
+        wejdzDoStanu2b(f);
+    }
+    else {
+        zmierzOczekiwanie(f, ZASOB_OKNO);
+        DZIENNIK_DOSTEP(f, ZD_DOSTEP_OKNO, INSIDE, -1);
+        wejdzDoStanu4(f);
+    }
+}
+
+// Zwolnienie zasobu, wystarczy powiadomic swoj rzad
+void kworumZwolnij(tfirma &f, int z) {
+    f.zasob[z].trzymane = 0;
+    f.lamport++;
+    for (int i = 0; i < f.rzad.size(); i++)
+        kworumWyslij(f, f.rzad[i], z, KWORUM_UPDATE, 0);
+}
+
+// KWORUM_REQUEST- jako arbiter udzielamy zgody albo kolejkujemy zadanie
+template <int Z> void kworumRequest(tfirma &f, tmessage &recvmessage, int source) {
+    tkworum &k = f.zasob[Z];
+    twczesniejsze wczesniejsze;
+    aktualizujZegar(f, recvmessage);
+    if (!k.zablokowany) {
+        kworumUdziel(f, Z, recvmessage);
+        return;
+    }
+    k.czekajacy.insert(recvmessage);
+    if (k.czekajacy.begin()->pid == recvmessage.pid && wczesniejsze(recvmessage, k.blokada)) {
+        // Nowe zadanie jest najwazniejsze, pytamy posiadacza zgody, czy ja odda
+        if (!k.zapytany) {
+            k.zapytany = true;
+            f.lamport++;
+            kworumWyslij(f, k.blokada.pid, Z, KWORUM_INQUIRE, 0);
+        }
+    }
+    else
+        kworumOdmow(f, Z, recvmessage.pid);
+    // Zadania o nizszym priorytecie nie dostana juz zgody przed nowym
+    std::set<tmessage, twczesniejsze>::iterator it = k.czekajacy.upper_bound(recvmessage);
+    for (; it != k.czekajacy.end(); ++it)
+        if (!k.odmowiono[it->pid]) kworumOdmow(f, Z, it->pid);
+}
+
+// KWORUM_GRANT- zgoda czlonka kworum z zajetoscia jego rzedu, ujemna wartosc -1 - suma
+// to nowa zajetosc dla posiadacza zgody
+template <int Z> void kworumGrant(tfirma &f, tmessage &recvmessage, int source) {
+    tkworum &k = f.zasob[Z];
+    aktualizujZegar(f, recvmessage);
+    if (recvmessage.val < 0) { // Nowa zajetosc od arbitra, ktorego zgode juz mamy
+        if (!k.ubiega || !k.zgoda[source]) return; // Dotyczy zgody z poprzedniego ubiegania sie
+        k.sumaOd[source] = -1 - recvmessage.val;
+        if (k.czeka) kworumSekcja(f, Z);
+        return;
+    }
+    if (!k.ubiega || k.zgoda[source]) return;
+    k.zgoda[source] = 1;
+    k.sumaOd[source] = recvmessage.val;
+    k.zgody++;
+    if (k.zgody == f.kworum.size())
+        kworumSekcja(f, Z);
+}
+
+// KWORUM_FAILED- nie dostaniemy teraz wszystkich zgod, oddajemy te, o ktore pytano
+template <int Z> void kworumFailed(tfirma &f, tmessage &recvmessage, int source) {
+    tkworum &k = f.zasob[Z];
+    aktualizujZegar(f, recvmessage);
+    if (!k.ubiega || k.czeka) return; // Ze wszystkimi zgodami nie ustepujemy
+    k.odmowa = true;
+    kworumOddaj(f, Z);
+}
+
+// KWORUM_INQUIRE- arbiter ma wazniejsze zadanie i pyta, czy oddamy zgode
+template <int Z> void kworumInquire(tfirma &f, tmessage &recvmessage, int source) {
+    tkworum &k = f.zasob[Z];
+    aktualizujZegar(f, recvmessage);
+    if (!k.ubiega || k.czeka || !k.zgoda[source]) return; // Zgoda juz zwolniona albo mamy wszystkie
+    k.pytajacy.push_back(source);
+    if (k.odmowa) kworumOddaj(f, Z);
+}
+
+// KWORUM_YIELD- posiadacz oddal zgode, udzielamy jej najwazniejszemu zadaniu
+template <int Z> void kworumYield(tfirma &f, tmessage &recvmessage, int source) {
+    tkworum &k = f.zasob[Z];
+    aktualizujZegar(f, recvmessage);
+    if (!k.zablokowany || k.blokada.pid != source) return;
+    k.odmowiono[source] = 1; // Oddajacy wie juz, ze musi czekac
+    k.czekajacy.insert(k.blokada);
+    tmessage nastepne = *k.czekajacy.begin();
+    k.czekajacy.erase(k.czekajacy.begin());
+    kworumUdziel(f, Z, nastepne);
+}
+
+// KWORUM_RELEASE- posiadacz zgody podjal decyzje
+template <int Z> void kworumRelease(tfirma &f, tmessage &recvmessage, int source) {
+    tkworum &k = f.zasob[Z];
+    aktualizujZegar(f, recvmessage);
+    if (!k.zablokowany || k.blokada.pid != source) return;
+    k.zablokowany = false;
+    if (!k.czekajacy.empty()) {
+        tmessage nastepne = *k.czekajacy.begin();
+        k.czekajacy.erase(k.czekajacy.begin());
+        kworumUdziel(f, Z, nastepne);
+    }
+}
+
+// KWORUM_UPDATE- firma z naszego rzedu zmienila liczbe zajetych jednostek
+template <int Z> void kworumUpdate(tfirma &f, tmessage &recvmessage, int source) {
+    tkworum &k = f.zasob[Z];
+    aktualizujZegar(f, recvmessage);
+    if (recvmessage.val > 0) {
+        zajmij(k.rzad, source, recvmessage.val);
+        return;
+    }
+    // Posiadacz naszej zgody moze czekac na miejsce, a my znamy zajetosc rzedu za niego
+    if (zwolnij(k.rzad, source) && k.zablokowany && czytelnikRzedu(f, k.blokada.pid, f.id / kolumnyKworum(f)) == f.id) {
+        f.lamport++;
+        kworumWyslij(f, k.blokada.pid, Z, KWORUM_GRANT, -1 - k.rzad.suma);
+    }
+}
+
+// INSIDE w stanie 2b w trybie kworum
+void koniecKlinikiKworum(tfirma &f, tmessage &recvmessage, int source) {
+    zglosMonitorowi(f, MONITOR_KLINIKA, 0);
+    kworumZwolnij(f, ZASOB_KLINIKA);
+    DZIENNIK_DOSTEP(f, ZD_WYJSCIE_RZAD, INSIDE, -1);
+    if (f.idiots > 0)
+        wejdzDoStanu2a(f);
+    else
+        wejdzDoStanu3(f);
+}
+
+// INSIDE w stanie 4 w trybie kworum
+void koniecPapierkologiiKworum(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_DOSTEP(f, ZD_PAPIERKOLOGIA, INSIDE, -1);
+    zglosMonitorowi(f, MONITOR_OKNO, 0);
+    kworumZwolnij(f, ZASOB_OKNO);
+    DZIENNIK_DOSTEP(f, ZD_OKNO_RZAD, INSIDE, -1);
+    wejdzDoStanu1(f);
+}
+
+// TRYB ZETONOW DLA OKIENEK-----------------------------------------------------
+
+/*
+ * Po urzedzie krazy L zetonow, a przy okienku moze byc tylko firma z zetonem.
+ * Po papierkologii firma zatrzymuje zeton, wiec gdy znow potrzebuje okienka,
+ * podchodzi od razu bez zadnej wiadomosci. Firma bez zetonu wysyla jedna
+ * prosbe do zarzadcy (firma 0), ktory wie, gdzie sa wolne zetony, i kaze
+ * posiadaczowi wolnego zetonu przekazac go proszacemu. Gdy wolnych nie ma,
+ * zarzadca kolejkuje prosbe do czasu, az ktos zglosi zwolnienie zetonu.
+ * Posiadacz, ktory dostal polecenie przekazania w trakcie papierkologii,
+ * oddaje zeton od razu po niej.
+ *
+*/
+
+#define ZARZADCA 0
+
+void zetonWyslij(tfirma &f, int cel, int tag, int val) {
+    f.lamport++;
+    tmessage message;
+    message.pid = f.id;
+    message.tim = f.lamport;
+    message.val = val;
+    wyslij(f, cel, tag, message);
+}
+
+void zbudujZetony(tfirma &f) {
+    f.zeton = -1;
+    f.zetonOdZarzadcy = false;
+    f.przekazDo = -1;
+    for (int t = 0; t < liczbaOkien(f); t++) {
+        if (t % f.N == f.id) f.zetony.push_back(t);
+        if (f.id == ZARZADCA) {
+            f.zetonGdzie.push_back(t % f.N);
+            f.zetonWolny.push_back(1);
+        }
+    }
+}
+
+void zetonUbiegaj(tfirma &f) {
+    if (!f.zetony.empty()) {
+        f.zeton = f.zetony.back();
+        f.zetony.pop_back();
+        f.zetonOdZarzadcy = false;
+        zmierzOczekiwanie(f, ZASOB_OKNO);
+        DZIENNIK_DOSTEP(f, ZD_WOLNY_ZETON, INSIDE, -1, f.zeton);
+        wejdzDoStanu4(f);
+        return;
+    }
+    zetonWyslij(f, ZARZADCA, OKNO_TOKEN_REQUEST, 0);
+    DZIENNIK_DOSTEP(f, ZD_ZETON_REQUEST, INSIDE, -1);
+}
+
+// Zarzadca kaze posiadaczowi wolnego zetonu t oddac go firmie pid
+void zetonPrzydziel(tfirma &f, int t, int pid) {
+    int posiadacz = f.zetonGdzie[t];
+    f.zetonGdzie[t] = pid;
+    f.zetonWolny[t] = 0;
+    zetonWyslij(f, posiadacz, OKNO_TOKEN_PASS, t * liczbaFirm(f) + pid);
+}
+
+// OKNO_TOKEN_REQUEST- zarzadca przydziela wolny zeton albo kolejkuje prosbe
+void zetonRequest(tfirma &f, tmessage &recvmessage, int source) {
+    aktualizujZegar(f, recvmessage);
+    for (int t = 0; t < liczbaOkien(f); t++)
+        if (f.zetonWolny[t]) {
+            zetonPrzydziel(f, t, recvmessage.pid);
+            return;
+        }
+    f.zetonKolejka.push_back(recvmessage.pid);
+}
+
+// OKNO_TOKEN_FREE- zeton przydzielony przez zarzadce jest znow wolny
+void zetonFree(tfirma &f, tmessage &recvmessage, int source) {
+    aktualizujZegar(f, recvmessage);
+    int t = recvmessage.val;
+    f.zetonWolny[t] = 1;
+    if (!f.zetonKolejka.empty()) {
+        int pid = f.zetonKolejka.front();
+        f.zetonKolejka.pop_front();
+        zetonPrzydziel(f, t, pid);
+    }
+}
+
+// OKNO_TOKEN_PASS- oddajemy wolny zeton od razu, a uzywany po papierkologii
+void zetonPass(tfirma &f, tmessage &recvmessage, int source) {
+    aktualizujZegar(f, recvmessage);
+    int t = recvmessage.val / liczbaFirm(f), pid = recvmessage.val % liczbaFirm(f);
+    if (f.zeton == t) {
+        f.przekazDo = pid;
+        return;
+    }
+    for (int i = 0; i < f.zetony.size(); i++)
+        if (f.zetony[i] == t) {
+            f.zetony.erase(f.zetony.begin() + i);
+            zetonWyslij(f, pid, OKNO_TOKEN, t);
+            DZIENNIK_WIADOMOSC(f, ZD_PRZEKAZUJE_ZETON, OKNO_TOKEN, pid, t, pid);
+            return;
+        }
+}
+
+// OKNO_TOKEN- dostalismy zeton, na ktory czekalismy
+void zetonOdebrany(tfirma &f, tmessage &recvmessage, int source) {
+    aktualizujZegar(f, recvmessage);
+    if (f.stan != STAN_3 || f.zeton != -1) {
+        f.zetony.push_back(recvmessage.val);
+        return;
+    }
+    f.zeton = recvmessage.val;
+    f.zetonOdZarzadcy = true;
+    zmierzOczekiwanie(f, ZASOB_OKNO);
+    DZIENNIK_DOSTEP(f, ZD_OTRZYMALA_ZETON, OKNO_TOKEN, recvmessage.pid, f.zeton, recvmessage.pid);
+    wejdzDoStanu4(f);
+}
+
+// INSIDE w stanie 4 w trybie zetonow
+void koniecPapierkologiiZeton(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_DOSTEP(f, ZD_PAPIERKOLOGIA, INSIDE, -1);
+    zglosMonitorowi(f, MONITOR_OKNO, 0);
+    if (f.przekazDo != -1) {
+        zetonWyslij(f, f.przekazDo, OKNO_TOKEN, f.zeton);
+        DZIENNIK_DOSTEP(f, ZD_ODDAJE_ZETON, OKNO_TOKEN, f.przekazDo, f.zeton, f.przekazDo);
+        f.przekazDo = -1;
+    }
+    else {
+        f.zetony.push_back(f.zeton);
+        if (f.zetonOdZarzadcy) // Zarzadca musi wiedziec, ze moze nim znow dysponowac
+            zetonWyslij(f, ZARZADCA, OKNO_TOKEN_FREE, f.zeton);
+        DZIENNIK_DOSTEP(f, ZD_ZATRZYMUJE_ZETON, INSIDE, -1, f.zeton);
+    }
+    f.zeton = -1;
+    f.zetonOdZarzadcy = false;
+    wejdzDoStanu1(f);
+}
+
+// TRYB LICZNIKOW---------------------------------------------------------------
+
+/*
+ * Miejsca w klinice i okienka to tylko liczby wolnych jednostek, wiec zamiast
+ * pytac wszystkie firmy, firma bierze jednostki z licznika zasobu, ktory
+ * prowadzi silnik. Gdy nikt nie czeka i cos jest wolne, zajecie konczy sie
+ * od razu. W przeciwnym razie firma staje w kolejce FIFO przy liczniku,
+ * a jednostki przydziela jej ta firma, ktora wpusci ja z poczatku kolejki,
+ * wiadomoscia LICZNIK_WPUSZCZENIE. Klinike firma zajmuje, ile jest wolnych
+ * miejsc, najwyzej tyle, ilu ma idiotow, tak jak w trybie Ricarta.
+ *
+ * W trybie rma idiokracja trzyma licznik w oknie RMA MPI-3 u firmy domowej
+ * zasobu i zmienia go operacjami atomowymi.
+ *
+ * Tak firma przechodzi stany w trybie wezlow: zasoby w trybie Ricarta
+ * przydziela jej wtedy lider wezla, a o jednostki dla calego wezla ubiega
+ * sie on u liderow innych wezlow.
+ *
+*/
+
+bool przezLicznik(tfirma &f, int z) {
+    if (z == ZASOB_KLINIKA)
+        return f.trybKliniki == KLINIKA_RMA || (f.wezly && f.trybKliniki == KLINIKA_RICART);
+    return f.trybOkna == OKNO_RMA || (f.wezly && f.trybOkna == OKNO_RICART);
+}
+
+// Uzyskalismy ile jednostek zasobu z, od razu albo z kolejki
+void wejdzZLicznika(tfirma &f, int z, int ile) {
+    zmierzOczekiwanie(f, z);
+    if (z == ZASOB_OKNO) {
+        DZIENNIK_DOSTEP(f, ZD_DOSTEP_OKNO, INSIDE, -1);
+        wejdzDoStanu4(f);
+        return;
+    }
+    f.tmp_idiots = f.idiots;
+    f.trzymane = ile;
+    f.idiots -= ile;
+    DZIENNIK_DOSTEP(f, ZD_DOSTEP_KLINIKA, INSIDE, -1, miejscaKliniki(f) - ile, f.tmp_idiots, ile);
+    zglosMonitorowi(f, MONITOR_KLINIKA, ile);
+    wejdzDoStanu2b(f);
+}
+
+void licznikUbiegaj(tfirma &f, int z) {
+    int chce = z == ZASOB_KLINIKA ? f.idiots : 1;
+    int ile = zajmijLicznik(f, z, chce);
+    if (ile > 0) {
+        DZIENNIK_DOSTEP(f, ZD_LICZNIK_ZAJELA, INSIDE, -1, ile, z);
+        wejdzZLicznika(f, z, ile);
+    }
+    else
+        DZIENNIK_DOSTEP(f, ZD_LICZNIK_CZEKA, INSIDE, -1, z, chce);
+}
+
+// Silnik wpuszcza firme pid z poczatku kolejki, przydzielajac jej ile jednostek
+void wpuscZLicznika(tfirma &f, int z, int pid, int ile) {
+    f.lamport++;
+    tmessage message;
+    message.pid = f.id;
+    message.tim = f.lamport;
+    message.val = ile;
+    wyslij(f, pid, LICZNIK_WPUSZCZENIE, message);
+    DZIENNIK_DOSTEP(f, ZD_LICZNIK_WPUSZCZA, LICZNIK_WPUSZCZENIE, pid, pid, ile, z);
+}
+
+// LICZNIK_WPUSZCZENIE w stanie 2a lub 3- czekalismy w kolejce licznika
+template <int Z> void licznikWpuszczenie(tfirma &f, tmessage &recvmessage, int source) {
+    aktualizujZegar(f, recvmessage);
+    wejdzZLicznika(f, Z, recvmessage.val);
+}
+
+// INSIDE w stanie 2b w trybie licznikow
+void koniecKlinikiLicznik(tfirma &f, tmessage &recvmessage, int source) {
+    zglosMonitorowi(f, MONITOR_KLINIKA, 0);
+    zwolnijLicznik(f, ZASOB_KLINIKA, f.trzymane);
+    DZIENNIK_DOSTEP(f, ZD_LICZNIK_ODDAJE, INSIDE, -1, f.trzymane, ZASOB_KLINIKA);
+    f.trzymane = 0;
+    if (f.idiots > 0)
+        wejdzDoStanu2a(f);
+    else
+        wejdzDoStanu3(f);
+}
+
+// INSIDE w stanie 4 w trybie licznikow
+void koniecPapierkologiiLicznik(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_DOSTEP(f, ZD_PAPIERKOLOGIA, INSIDE, -1);
+    zglosMonitorowi(f, MONITOR_OKNO, 0);
+    zwolnijLicznik(f, ZASOB_OKNO, 1);
+    DZIENNIK_DOSTEP(f, ZD_LICZNIK_ODDAJE, INSIDE, -1, 1, ZASOB_OKNO);
+    wejdzDoStanu1(f);
+}
+
+// OBSLUGA WSPOLNA DLA WIELU STANOW---------------------------------------------
+
+// KLINIKA_REQUEST gdy nie ubiegamy sie o klinike, wiec od razu wysylamy AGREE
+void klinikaRequestZgoda(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, KLINIKA_REQUEST, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage); // aktualizujemy zegar Lamporta po odebraniu wiadomosci
+    dodajDoKliniki(f, recvmessage); // dodajemy firme do listy obecnych w klinice
+    f.lamport++;
+    tmessage message;
+    message.pid = f.id;
+    message.tim = f.lamport;
+    message.val = 0;
+    wyslij(f, source, KLINIKA_AGREE, message);  // Wysylamy wiadomosc KLINIKA_AGREE, bo nie ubiegamy sie o klinike
+    DZIENNIK_WIADOMOSC(f, ZD_WYSYLA, KLINIKA_AGREE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+}
+
+// OKNO_REQUEST gdy nie ubiegamy sie o okno, wiec od razu wysylamy AGREE
+void oknoRequestZgoda(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_OTRZYMALA, OKNO_REQUEST, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+    f.lamport++;
+    tmessage message;
+    message.pid = f.id;
+    message.tim = f.lamport;
+    message.val = recvmessage.val;  // Wysylamy rowniez zegar Lamporta, z ktorym wysylano nam OKNO_REQUEST
+    wyslij(f, source, OKNO_AGREE, message); // Wysylamy wiadomosc OKNO_AGREE, bo nie ubiegamy sie o okna
+    DZIENNIK_WIADOMOSC(f, ZD_WYSYLA, OKNO_AGREE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+}
+
+// KLINIKA_AGREE gdy nie ubiegamy sie o klinike- musimy czyscic nasza liste zapamietanych procesow w klinice, aby uniknac bledow
+void klinikaAgreeZwolnienie(tfirma &f, tmessage &recvmessage, int source) {
+    DZIENNIK_WIADOMOSC(f, ZD_ZWALNIAJACA, KLINIKA_AGREE, recvmessage.pid, recvmessage.tim, recvmessage.pid);
+    aktualizujZegar(f, recvmessage);
+    if (recvmessage.val > 0) //Jezeli ktos zwalnia miejsce w klinice i wysyla nam zgode, to musimy go usunac z naszej listy obecnych w klinice
+        usunZKliniki(f, recvmessage.pid);
+}
+
+// Gdy dostajemy jakies przestarzale wiadomosci, bez ladu i skladu to jedynie aktualizujemy zegar
+void tylkoZegar(tfirma &f, tmessage &recvmessage, int source) {
+    aktualizujZegar(f, recvmessage);
+}
+
+// MONITOR_ZEGAR- takt monitora, odpowiadamy zegarem po aktualizacji
+void monitorZegar(tfirma &f, tmessage &recvmessage, int source) {
+    aktualizujZegar(f, recvmessage);
+    zglosMonitorowi(f, MONITOR_ZEGAR, 0);
+}
+
+// INSIDE w stanie, w ktorym nie odliczamy czasu
+void ignoruj(tfirma &f, tmessage &recvmessage, int source) {
+}
+
+// STAN KONIEC I BENCHMARK------------------------------------------------------
+
+/*
+ * Firma po ostatniej rundzie benchmarku albo po otrzymaniu KONIEC_PRACY
+ * przechodzi do STAN_KONIEC, w ktorym dalej odpowiada innym firmom, a o
+ * zatrzymaniu decyduje silnik. Rundy nie przerywamy, bo inne firmy moga
+ * czekac na zwolnienie zajetych przez nas miejsc i okienek.
+ *
+*/
+
+void wejdzDoStanuKoniec(tfirma &f) {
+    f.stan = STAN_KONIEC;
+    f.czasPracy = czasSilnika() - f.czasStartu;
+    zakonczPrace(f);
+}
+
+// KONIEC_PRACY- konczymy po biezacej rundzie, a czekajac na idiotow od razu
+void koniecPracy(tfirma &f, tmessage &recvmessage, int source) {
+    aktualizujZegar(f, recvmessage);
+    if (f.zatrzymana) return;
+    f.zatrzymana = true;
+    if (f.stan == STAN_1) {
+        f.rundy--; // Runda jeszcze sie nie zaczela, pobudke zignorujemy w STAN_KONIEC
+        wejdzDoStanuKoniec(f);
+    }
+}
+
+void inicjujBenchmark(tfirma &f) {
+    f.rundy = 0;
+    f.wyslane = 0;
+    f.czasPracy = 0;
+    f.opoznienia[ZASOB_KLINIKA].assign(KUBELKI_OPOZNIEN, 0);
+    f.opoznienia[ZASOB_OKNO].assign(KUBELKI_OPOZNIEN, 0);
+    for (int i = 0; i < LICZBA_STANOW; i++) {
+        f.sumaCzasow[i] = 0;
+        f.liczbaDostepow[i] = 0;
+    }
+}
+
+// Czas w ms, ponizej ktorego jest czesc p wszystkich pomiarow
+double percentyl(const std::vector<long long> &h, long long suma, double p) {
+    long long prog = (long long) (p * suma);
+    long long narastajaco = 0;
+    for (int k = 0; k < KUBELKI_OPOZNIEN; k++) {
+        narastajaco += h[k];
+        if (narastajaco > prog) return dolnaGranicaKubelka(k) / 1000.0;
+    }
+    return 0;
+}
+
+// Wypisuje wyniki zebrane ze wszystkich firm, paczki < 0 gdy silnik nie laczy wiadomosci w paczki
+void wypiszWyniki(tfirma &f, double czas, std::vector<long long> opoznienia[2], long long wiadomosci, long long paczki) {
+    const char * nazwa[2] = {"klinika", "okienka"};
+    long long dostepy = 0;
+    for (int z = 0; z < 2; z++) {
+        long long suma = 0;
+        for (int k = 0; k < KUBELKI_OPOZNIEN; k++)
+            suma += opoznienia[z][k];
+        dostepy += suma;
+        printf("%s: %lld dostepow, %.1f dostepow/s, oczekiwanie p50 %.3f ms, p99 %.3f ms, p999 %.3f ms\n",
+               nazwa[z], suma, czas > 0 ? suma / czas : 0.0,
+               percentyl(opoznienia[z], suma, 0.5), percentyl(opoznienia[z], suma, 0.99),
+               percentyl(opoznienia[z], suma, 0.999));
+    }
+    printf("wiadomosci: %lld, %.1f na dostep", wiadomosci, dostepy > 0 ? (double) wiadomosci / dostepy : 0.0);
+    if (paczki >= 0)
+        printf(", w %lld paczkach, %.1f paczek na dostep", paczki, dostepy > 0 ? (double) paczki / dostepy : 0.0);
+    printf("\n");
+    fflush(stdout);
+}
+
+// TABLICA OBSLUGI--------------------------------------------------------------
+
+tobsluga obsluga[LICZBA_STANOW][LICZBA_TAGOW] = {
+    //                INSIDE                KLINIKA_REQUEST          KLINIKA_AGREE            OKNO_REQUEST          OKNO_AGREE      KLINIKA_RELEASE
+    /* STAN_1 */      { koniecCzekania,      klinikaRequestZgoda,     klinikaAgreeZwolnienie,  oknoRequestZgoda,     tylkoZegar,     tylkoZegar },
+    /* STAN_2A */     { ignoruj,             klinikaRequestPriorytet, klinikaAgreeZgoda,       oknoRequestZgoda,     tylkoZegar,     tylkoZegar },
+    /* STAN_2B */     { koniecKliniki,       klinikaRequestWKlinice,  klinikaAgreeWKlinice,    oknoRequestZgoda,     tylkoZegar,     tylkoZegar },
+    /* STAN_3 */      { ignoruj,             klinikaRequestZgoda,     klinikaAgreeZwolnienie,  oknoRequestPriorytet, oknoAgreeZgoda, tylkoZegar },
+    /* STAN_4 */      { koniecPapierkologii, klinikaRequestZgoda,     klinikaAgreeZwolnienie,  oknoRequestKolejkuj,  tylkoZegar,     tylkoZegar },
+    /* STAN_KONIEC */ { ignoruj,             klinikaRequestZgoda,     klinikaAgreeZwolnienie,  oknoRequestZgoda,     tylkoZegar,     tylkoZegar }
+};
+
+// Nakladka na tablice obslugi w trybie semafora wazonego, NULL oznacza obsluge bez zmian
+tobsluga obslugaSemafora[LICZBA_STANOW][LICZBA_TAGOW] = {
+    //                INSIDE                KLINIKA_REQUEST          KLINIKA_AGREE            OKNO_REQUEST          OKNO_AGREE      KLINIKA_RELEASE
+    /* STAN_1 */      { NULL,                semaforRequestZgoda,     tylkoZegar,              NULL,                 NULL,           semaforRelease },
+    /* STAN_2A */     { NULL,                semaforRequestPriorytet, semaforAgree,            NULL,                 NULL,           semaforRelease },
+    /* STAN_2B */     { koniecKlinikiSemafor, semaforRequestZgoda,    tylkoZegar,              NULL,                 NULL,           semaforRelease },
+    /* STAN_3 */      { NULL,                semaforRequestZgoda,     tylkoZegar,              NULL,                 NULL,           semaforRelease },
+    /* STAN_4 */      { NULL,                semaforRequestZgoda,     tylkoZegar,              NULL,                 NULL,           semaforRelease },
+    /* STAN_KONIEC */ { NULL,                semaforRequestZgoda,     tylkoZegar,              NULL,                 NULL,           semaforRelease }
+};
+
+// Wlacza w tablicy obslugi tryb kworum dla zasobu Z
+template <int Z> void wlaczKworum() {
+    for (int stan = 0; stan < LICZBA_STANOW; stan++) {
+        obsluga[stan][tagKworum(Z, KWORUM_REQUEST)] = kworumRequest<Z>;
+        obsluga[stan][tagKworum(Z, KWORUM_GRANT)]   = kworumGrant<Z>;
+        obsluga[stan][tagKworum(Z, KWORUM_FAILED)]  = kworumFailed<Z>;
+        obsluga[stan][tagKworum(Z, KWORUM_INQUIRE)] = kworumInquire<Z>;
+        obsluga[stan][tagKworum(Z, KWORUM_YIELD)]   = kworumYield<Z>;
+        obsluga[stan][tagKworum(Z, KWORUM_RELEASE)] = kworumRelease<Z>;
+        obsluga[stan][tagKworum(Z, KWORUM_UPDATE)]  = kworumUpdate<Z>;
+    }
+    if (Z == ZASOB_KLINIKA)
+        obsluga[STAN_2B][INSIDE] = koniecKlinikiKworum;
+    else
+        obsluga[STAN_4][INSIDE] = koniecPapierkologiiKworum;
+}
+
+// Wlacza w tablicy obslugi tryb zetonow dla okienek
+void wlaczZetony() {
+    for (int stan = 0; stan < LICZBA_STANOW; stan++) {
+        obsluga[stan][OKNO_TOKEN_REQUEST] = zetonRequest;
+        obsluga[stan][OKNO_TOKEN]         = zetonOdebrany;
+        obsluga[stan][OKNO_TOKEN_PASS]    = zetonPass;
+        obsluga[stan][OKNO_TOKEN_FREE]    = zetonFree;
+    }
+    obsluga[STAN_4][INSIDE] = koniecPapierkologiiZeton;
+}
+
+// Wlacza w tablicy obslugi tryb licznikow dla zasobu Z
+template <int Z> void wlaczLicznik() {
+    if (Z == ZASOB_KLINIKA) {
+        obsluga[STAN_2A][LICZNIK_WPUSZCZENIE] = licznikWpuszczenie<Z>;
+        obsluga[STAN_2B][INSIDE] = koniecKlinikiLicznik;
+    }
+    else {
+        obsluga[STAN_3][LICZNIK_WPUSZCZENIE] = licznikWpuszczenie<Z>;
+        obsluga[STAN_4][INSIDE] = koniecPapierkologiiLicznik;
+    }
+}
+
+// Wlacza w tablicy obslugi odpowiedzi na takty monitora
+void wlaczMonitor() {
+    for (int stan = 0; stan < LICZBA_STANOW; stan++)
+        obsluga[stan][MONITOR_ZEGAR] = monitorZegar;
+}
+
+// Zatrzymanie dziala w kazdym trybie
+void wlaczZatrzymanie() {
+    for (int stan = 0; stan < LICZBA_STANOW; stan++)
+        obsluga[stan][KONIEC_PRACY] = koniecPracy;
+}
+
+// Podmienia w tablicy obslugi wszystkie pola, ktore nakladka ustawia
+void nalozObsluge(tobsluga nakladka[LICZBA_STANOW][LICZBA_TAGOW]) {
+    for (int stan = 0; stan < LICZBA_STANOW; stan++)
+        for (int tag = 0; tag < LICZBA_TAGOW; tag++)
+            if (nakladka[stan][tag] != NULL)
+                obsluga[stan][tag] = nakladka[stan][tag];
+}
+
+// Przekazuje zdarzenie do obslugi wg stanu i tagu
+void obsluz(tfirma &f, int tag, tmessage &message, int source) {
+    if (tag < 0 || tag >= LICZBA_TAGOW) {
+        tylkoZegar(f, message, source);
+        return;
+    }
+    f.liczniki->obsluzone[f.stan][tag]++;
+    if (obsluga[f.stan][tag] == NULL)
+        tylkoZegar(f, message, source);
+    else
+        obsluga[f.stan][tag](f, message, source);
+}
+
+// Po kazdym zdarzeniu: czas w stanach i dlugosci kolejek odlozonych zadan
+void policzZdarzenie(tfirma &f) {
+    tliczniki * l = f.liczniki;
+    double teraz = czasSilnika();
+    if (f.stan != l->stan) {
+        l->czasStanu[l->stan] += teraz - l->wejscieDoStanu;
+        l->wejscieDoStanu = teraz;
+        l->wejscia[f.stan]++;
+        l->stan = f.stan;
+    }
+    l->lamport = f.lamport;
+    l->aktualizacja = teraz;
+
+    l->klinikaCzeka = f.klinikawaiting.size() + f.zasob[ZASOB_KLINIKA].czekajacy.size();
+    l->okienkaCzeka = f.okienkawaiting.size() + f.zasob[ZASOB_OKNO].czekajacy.size() + f.zetonKolejka.size();
+    if (l->klinikaCzeka > l->klinikaCzekaMax) l->klinikaCzekaMax = l->klinikaCzeka;
+    if (l->okienkaCzeka > l->okienkaCzekaMax) l->okienkaCzekaMax = l->okienkaCzeka;
+}
+
+// Obsluguje wiadomosci wyslane do samego siebie
+void obsluzDoSiebie(tfirma &f) {
+    while (!f.doSiebie.empty()) {
+        tlokalna lokalna = f.doSiebie.front();
+        f.doSiebie.pop_front();
+        obsluz(f, lokalna.tag, lokalna.message, f.id);
+    }
+}
+
+// Obsluguje wiadomosc od innej firmy i wiadomosci, ktore wyslalismy przy tym do siebie
+void obsluzWiadomosc(tfirma &f, int tag, tmessage &message, int source) {
+    if (tag == INSIDE) // INSIDE pochodzi tylko od naszego silnika
+        tylkoZegar(f, message, source);
+    else
+        obsluz(f, tag, message, source);
+    obsluzDoSiebie(f);
+    policzZdarzenie(f);
+}
+
+// Obsluguje koniec czasu zleconego silnikowi przez uruchomSterowanie
+void obsluzPobudke(tfirma &f) {
+    tmessage pobudka;
+    pobudka.pid = f.id;  // Zdarzenie od naszego silnika
+    pobudka.tim = -1;    // Zdarzenia INSIDE nie zmieniaja zegaru Lamporta
+    pobudka.val = 0;
+    obsluz(f, INSIDE, pobudka, f.id);
+    obsluzDoSiebie(f);
+    policzZdarzenie(f);
+}
+
+// Silnik zmienil stan poza obsluga zdarzenia firmy, np. lider wezla wpuscil z kolejki sam siebie
+void obsluzZdarzenieSilnika(tfirma &f) {
+    obsluzDoSiebie(f);
+    policzZdarzenie(f);
+}
+
+// Pierwsze zdarzenie firmy, wywolywane przez silnik po jego przygotowaniu
+void uruchomFirme(tfirma &f) {
+    f.liczniki->wejscieDoStanu = czasSilnika();
+    wejdzDoStanu1(f);
+    obsluzDoSiebie(f);
+    policzZdarzenie(f);
+}
+
+// Zatrzymanie zlecone z zewnatrz, np. sygnalem, przekazujemy wszystkim firmom
+void zatrzymajFirme(tfirma &f) {
+    if (f.zatrzymana) return;
+    f.lamport++;
+    tmessage koniec;
+    koniec.pid = f.id;
+    koniec.tim = f.lamport;
+    koniec.val = 0;
+    rozeslij(f, KONIEC_PRACY, koniec);
+    wyslij(f, f.id, KONIEC_PRACY, koniec);
+    obsluzDoSiebie(f);
+    policzZdarzenie(f);
+}
+
+// Zeruje liczniki firmy, wywolywana przed uruchomFirme
+void podlaczLiczniki(tfirma &f, tliczniki * liczniki) {
+    memset(liczniki, 0, sizeof(tliczniki));
+    memcpy(liczniki->magia, "IDZL", 4);
+    liczniki->wersja = WERSJA_LICZNIKOW;
+    liczniki->id = f.id;
+    liczniki->N = f.N;
+    liczniki->stan = STAN_1;
+    liczniki->wejscia[STAN_1] = 1;
+    f.liczniki = liczniki;
+}
+
+// Przygotowuje stan firmy, wymaga ustawionych id, N, K, L i trybow
+void inicjujFirme(tfirma &f) {
+    f.lamport = 0;
+    f.idiots = 0;
+    f.tmp_idiots = 0;
+    f.trzymane = 0;
+    inicjujZgody(f.agree, f.N);
+    f.zatrzymana = false;
+    inicjujZajetosc(f.klinikainside, f.N);
+    zbudujKworum(f);
+    zbudujZetony(f);
+}
+
+// Dostosowuje tablice obslugi do trybow firmy, tablica jest wspolna dla wszystkich firm procesu
+void ustawObsluge(tfirma &f) {
+    if (f.trybKliniki == KLINIKA_SEMAFOR)
+        nalozObsluge(obslugaSemafora);
+    if (f.trybKliniki == KLINIKA_KWORUM)
+        wlaczKworum<ZASOB_KLINIKA>();
+    if (f.trybOkna == OKNO_KWORUM)
+        wlaczKworum<ZASOB_OKNO>();
+    if (f.trybOkna == OKNO_ZETON)
+        wlaczZetony();
+    if (przezLicznik(f, ZASOB_KLINIKA))
+        wlaczLicznik<ZASOB_KLINIKA>();
+    if (przezLicznik(f, ZASOB_OKNO))
+        wlaczLicznik<ZASOB_OKNO>();
+    if (f.monitor >= 0)
+        wlaczMonitor();
+    wlaczZatrzymanie();
+}
@@ -0,0 +1,314 @@
+#ifndef FIRMA_H
+#define FIRMA_H
+
+#include <vector>
+#include <deque>
+#include <queue>
+#include <set>
+#include "protokol.h"
+#include "dziennik.h"
+#include "liczniki.h"
+
+/*
+ * Firma idiokracji: stan firmy i obsluga zdarzen protokolu
+ *
+ * Logika firm z firma.cpp nie wie, w jakim silniku dziala. idiokracja.cpp
+ * uruchamia jedna firme w kazdym procesie MPI, a symulator.cpp wiele firm
+ * w jednym procesie w czasie wirtualnym. Kazdy silnik dostarcza funkcje
+ * z sekcji SILNIK, a zdarzenia przekazuje do obsluzWiadomosc i obsluzPobudke.
+ *
+*/
+
+// Tryby ubiegania sie o klinike
+#define KLINIKA_RICART   0 // zgody wszystkich firm, zajetosc wg wlasnej listy obecnych w klinice
+#define KLINIKA_SEMAFOR  1 // semafor wazony, zgody niosa liczbe miejsc zajmowanych przez nadawce
+#define KLINIKA_KWORUM   2 // zgody tylko od kworum w siatce firm
+#define KLINIKA_RMA      3 // licznik wolnych miejsc w oknie RMA, zajecie bez czekajacych to jedna operacja atomowa
+
+// Tryby ubiegania sie o okienko
+#define OKNO_RICART      0
+#define OKNO_KWORUM      1
+#define OKNO_ZETON       2 // L zetonow, firma z wolnym zetonem podchodzi od razu
+#define OKNO_RMA         3 // licznik wolnych okienek w oknie RMA
+
+// Zasoby w trybach kworum i licznikow
+#define ZASOB_KLINIKA    0
+#define ZASOB_OKNO       1
+
+// Rozmiary znane w czasie kompilacji, np. make STALE="-DSTALE_N=8 -DSTALE_K=16 -DSTALE_L=2".
+// Zgody i kolejki zadan leza wtedy w tablicach o stalym rozmiarze wewnatrz
+// firmy, a petle po firmach i okienkach maja stale granice. Silnik odmawia
+// pracy, gdy rozmiary z uruchomienia sa inne.
+
+typedef struct {
+    int pid; // Pole do zapamietania id procesu wysylajacego wiadomosc
+    int tim; // Pole do zapamietania zegaru Lamporta procesu wysylajacego wiadomosc
+    int val; // Pole do zapamietania wartosci dodatkowych, jak liczba idiotow dla kliniki czy czas Lamporta zadania procesu
+} tmessage;
+
+// Porzadek priorytetu odlozonych zadan: wczesniejszy zegar Lamporta, a przy
+// rownych zegarach mniejsze id firmy
+struct tpozniejsze {
+    bool operator()(const tmessage &a, const tmessage &b) const {
+        return a.tim > b.tim || (a.tim == b.tim && a.pid > b.pid);
+    }
+};
+
+struct twczesniejsze {
+    bool operator()(const tmessage &a, const tmessage &b) const {
+        return a.tim < b.tim || (a.tim == b.tim && a.pid < b.pid);
+    }
+};
+
+#ifdef STALE_N
+// Wektor pod kolejke zadan z miejscem na P elementow wewnatrz firmy. Zwykle
+// kazda firma ma w kolejce jedno zadanie, ale przedawnione zadanie moze czekac
+// obok nowego, wiec po przepelnieniu elementy przenosza sie na sterte.
+template <typename T, int P> struct tmalyWektor {
+    typedef T value_type;
+    typedef T & reference;
+    typedef const T & const_reference;
+    typedef int size_type;
+    typedef T * iterator;
+    typedef const T * const_iterator;
+
+    T wbudowane[P];
+    std::vector<T> sterta; // Niepusta tylko po przepelnieniu, trzyma wtedy wszystkie elementy
+    int ile;
+
+    tmalyWektor() : ile(0) {}
+    T * dane() { return sterta.empty() ? wbudowane : &sterta[0]; }
+    const T * dane() const { return sterta.empty() ? wbudowane : &sterta[0]; }
+    bool empty() const { return ile == 0; }
+    int size() const { return ile; }
+    T & front() { return dane()[0]; }
+    const T & front() const { return dane()[0]; }
+    T * begin() { return dane(); }
+    T * end() { return dane() + ile; }
+    void pop_back() {
+        if (!sterta.empty()) sterta.pop_back();
+        ile--;
+    }
+    void push_back(const T &x) {
+        if (sterta.empty() && ile < P) {
+            wbudowane[ile++] = x;
+            return;
+        }
+        if (sterta.empty()) sterta.assign(wbudowane, wbudowane + ile);
+        sterta.push_back(x);
+        ile++;
+    }
+};
+
+// Kolejka odlozonych zadan, na szczycie zadanie o najwyzszym priorytecie
+typedef std::priority_queue<tmessage, tmalyWektor<tmessage, 2 * STALE_N>, tpozniejsze> tkolejka;
+#else
+// Kolejka odlozonych zadan, na szczycie zadanie o najwyzszym priorytecie
+typedef std::priority_queue<tmessage, std::vector<tmessage>, tpozniejsze> tkolejka;
+#endif
+
+// Obecni w klinice wg naszej wiedzy, indeksowani id firmy. Kazda firma moze
+// byc w klinice co najwyzej raz, wiec ponowne dodanie zastepuje jej wpis.
+typedef struct {
+    std::vector<int> miejsca;  // Liczba idiotow danej firmy w klinice
+    std::vector<char> obecna;  // Czy firma jest na liscie obecnych w klinice
+    int suma;                  // Suma idiotow wszystkich obecnych w klinice
+} tzajetosc;
+
+// Stan jednego zasobu w trybie kworum (algorytm Maekawy)
+typedef struct {
+    // Rola arbitra
+    bool zablokowany;            // Czy udzielilismy komus zgody
+    tmessage blokada;            // Zadanie, ktoremu udzielilismy zgody
+    bool zapytany;               // Czy wyslalismy INQUIRE do posiadacza zgody
+    std::set<tmessage, twczesniejsze> czekajacy; // Odlozone zadania wg priorytetu
+    std::vector<char> odmowiono; // Komu z czekajacych wyslalismy juz FAILED
+    tzajetosc rzad;              // Jednostki zasobu zajete przez firmy z naszego rzedu
+
+    // Rola ubiegajacego sie
+    bool ubiega;                 // Czy ubiegamy sie o zasob
+    int zgody;                   // Liczba zgod od czlonkow kworum
+    std::vector<char> zgoda;     // Od kogo mamy zgode
+    std::vector<int> sumaOd;     // Zajetosc rzedu podana w zgodzie
+    bool odmowa;                 // Czy dostalismy FAILED, wtedy oddajemy zgody pytajacym
+    bool czeka;                  // Mamy zgody calego kworum, ale brak wolnych jednostek
+    std::vector<int> pytajacy;   // Arbitrzy, ktorzy wyslali INQUIRE
+    int trzymane;                // Ile jednostek zasobu zajmujemy
+} tkworum;
+
+// Zgody na biezace zadanie, bit na kazda firme. Slowo bitow jest wazne tylko
+// z epoka biezacego zadania, wiec nowe zadanie zeruje zgody w O(1), a liczba
+// zgod to suma popcount po slowach z biezaca epoka.
+typedef struct {
+#ifdef STALE_N
+    unsigned long long bity[(STALE_N + 63) / 64];
+    unsigned epoki[(STALE_N + 63) / 64];
+#else
+    std::vector<unsigned long long> bity;
+    std::vector<unsigned> epoki;
+#endif
+    unsigned epoka;
+} tzgody;
+
+// Wiadomosc wyslana do samego siebie, obslugiwana po biezacym zdarzeniu bez udzialu silnika
+typedef struct {
+    int tag;
+    tmessage message;
+} tlokalna;
+
+typedef struct {
+    // Program parameters
+    int id,        // Id firmy / procesu
+        N,         // Liczba firm / procesow
+        K,         // Liczba miejsc w klinice
+        L;         // Liczba okienek w urzedzie
+
+    // Program variables
+    int stan;      // Aktualny stan silnika protokolu
+    int idiots;    // Liczba idiotow
+    int lamport;   // Zegar Lamporta, poczatkowa wartosc to 0
+    int tmp_idiots;// Poprzednia liczba idiotow, jest trzymana na potrzeby wyslania wiadomosci o zwolnieniu kliniki
+    int trybKliniki; // Sposob ubiegania sie o klinike
+    int trzymane;  // Tryby semafora i licznikow: liczba miejsc w klinice zajmowanych przez nas
+    int trybOkna;  // Sposob ubiegania sie o okienko
+    bool wezly;    // Klinike i okienka w trybie Ricarta przydziela lider wezla przez silnik, jak w trybie licznikow
+
+    // Zmienne ubiegania sie o sekcje (stany 2a i 3)
+    int lamportonrequest; // Zegar Lamporta przy wyslaniu zadania, aby nie uznac przedawnionej zgody
+    tzgody agree;         // Od kogo otrzymalismy juz zgode
+
+    tzajetosc klinikainside;
+    tkolejka klinikawaiting;
+    tkolejka okienkawaiting;
+
+    // Rozsylanie zadan i pomiar czasu od zadania do dostepu
+    bool rozsylanieBlokujace;             // Wysylanie paczek przez MPI_Send zamiast MPI_Isend
+    double czasZadania;                   // czasSilnika() przy rozeslaniu zadania
+    double sumaCzasow[LICZBA_STANOW];     // Suma czasow oczekiwania na dostep w stanach 2a i 3, w mikrosekundach
+    int liczbaDostepow[LICZBA_STANOW];    // Liczba uzyskanych dostepow w stanach 2a i 3
+
+    // Tryb kworum, siatka ceil(sqrt(N)) kolumn
+    std::vector<int> kworum;     // Nasz rzad, nasza kolumna i ewentualnie ostatnia firma
+    std::vector<int> rzad;       // Firmy z naszego rzedu, im zglaszamy zajete jednostki
+    std::vector<int> czytelnicy; // Po jednym czlonku kworum z kazdego rzedu
+    tkworum zasob[2];            // Klinika i okienka
+
+    // Tryb zetonow dla okienek, zarzadca to firma 0
+    std::vector<int> zetony;      // Wolne zetony, ktore mamy u siebie
+    int zeton;                    // Zeton, z ktorym jestesmy przy okienku, -1 gdy brak
+    bool zetonOdZarzadcy;         // Czy zarzadca uwaza nasz zeton za zajety
+    int przekazDo;                // Komu oddac zeton po papierkologii, -1 gdy nikomu
+    std::vector<int> zetonGdzie;  // Zarzadca: u kogo jest zeton
+    std::vector<char> zetonWolny; // Zarzadca: czy zeton jest wolny
+    std::deque<int> zetonKolejka; // Zarzadca: firmy czekajace na zeton
+
+    std::deque<tlokalna> doSiebie; // Wiadomosci do samego siebie
+
+    int monitor;          // Id procesu monitora, -1 gdy dzialamy bez niego
+    int poziomDziennika;  // Zapisy powyzej tego poziomu nie trafiaja do dziennika
+
+    // Czasy w ms i liczba idiotow, domyslnie max_wait_* i max_idiots
+    int maxIdiotow;       // Idiotow przychodzi od 1 do maxIdiotow - 1
+    int czasIdiotow;      // Maksymalny czas oczekiwania na idiotow
+    int czasKliniki;      // Maksymalny czas pobytu w klinice
+    int czasOkna;         // Maksymalny czas papierkologii
+
+    // Tryb benchmarku, bez niego firmy pracuja do otrzymania KONIEC_PRACY
+    bool benchmark;
+    int maxRund;          // Liczba rund do wykonania, 0 gdy bez ograniczenia
+    double czasKonca;     // czasSilnika() konca benchmarku, 0 gdy bez ograniczenia
+    bool zatrzymana;      // Otrzymala KONIEC_PRACY, konczy po biezacej rundzie
+    int rundy;            // Rozpoczete rundy
+    double czasStartu;
+    double czasPracy;     // Czas od startu do wejscia w STAN_KONIEC
+    long long wyslane;    // Wiadomosci wyslane do innych firm
+    std::vector<long long> opoznienia[2]; // Histogramy czasu do dostepu do kliniki i okienka
+
+    tliczniki * liczniki; // Liczniki pracy, pamiec dostarcza silnik
+} tfirma;
+
+// Rozmiary w petlach i warunkach obslugi, stale przy kompilacji z STALE_*
+#ifdef STALE_N
+inline int liczbaFirm(const tfirma &f)     { return STALE_N; }
+#else
+inline int liczbaFirm(const tfirma &f)     { return f.N; }
+#endif
+#ifdef STALE_K
+inline int miejscaKliniki(const tfirma &f) { return STALE_K; }
+#else
+inline int miejscaKliniki(const tfirma &f) { return f.K; }
+#endif
+#ifdef STALE_L
+inline int liczbaOkien(const tfirma &f)    { return STALE_L; }
+#else
+inline int liczbaOkien(const tfirma &f)    { return f.L; }
+#endif
+
+// Obsluga wiadomosci o danym tagu w danym stanie
+typedef void (*tobsluga)(tfirma &f, tmessage &recvmessage, int source);
+
+// Program constants
+const int max_idiots   = 20;   // domyslna maksymalna liczba idiotow
+const int max_wait_i   = 4000; // domyslny maksymalny czas oczekiwania na idiotow w ms
+const int max_wait_k   = 4000; // domyslny maksymalny czas pobytu w klinice w ms
+const int max_wait_o   = 4000; // domyslny maksymalny czas papierkologii w ms
+
+// Histogram czasu od zadania do dostepu: ponizej 16 us kubelek na kazda
+// mikrosekunde, wyzej 16 kubelkow na kazda potege dwojki
+#define KUBELKI_OPOZNIEN (16 + 40 * 16)
+
+// SILNIK-----------------------------------------------------------------------
+
+// Wysyla wiadomosc do innej firmy, wiadomosci do jednej firmy dochodza w kolejnosci wyslania
+void nadaj(tfirma &f, int cel, int tag, tmessage &message);
+
+// Po ms milisekundach silnik wywola obsluzPobudke, zlecenia odlicza po kolei
+void odliczCzas(tfirma &f, int ms);
+
+// Czas w sekundach do pomiarow czasu oczekiwania i trwania benchmarku
+double czasSilnika();
+
+// Firma weszla do STAN_KONIEC, dalej odpowiada innym firmom, dopoki wszystkie nie skoncza
+void zakonczPrace(tfirma &f);
+
+// Tryb licznikow i wezlow: zajmuje od 1 do ile jednostek zasobu z i zwraca ich liczbe.
+// Gdy inne firmy juz czekaja albo nic nie jest wolne, ustawia firme w kolejce
+// i zwraca 0, a jednostki przydzieli jej pozniej wpuscZLicznika.
+int zajmijLicznik(tfirma &f, int z, int ile);
+
+// Oddaje ile jednostek zasobu z i wpuszcza czekajacych z poczatku kolejki
+void zwolnijLicznik(tfirma &f, int z, int ile);
+
+// Dodaje zapis do dziennika firmy
+void zapisz(tfirma &f, int zdarzenie, int tag, int peer, int a = 0, int b = 0, int c = 0, int d = 0);
+
+#if DZIENNIK_POZIOM >= POZIOM_DOSTEP
+#define DZIENNIK_DOSTEP(f, ...) do { if ((f).poziomDziennika >= POZIOM_DOSTEP) zapisz(f, __VA_ARGS__); } while (0)
+#else
+#define DZIENNIK_DOSTEP(...) do {} while (0)
+#endif
+
+#if DZIENNIK_POZIOM >= POZIOM_WIADOMOSCI
+#define DZIENNIK_WIADOMOSC(f, ...) do { if ((f).poziomDziennika >= POZIOM_WIADOMOSCI) zapisz(f, __VA_ARGS__); } while (0)
+#else
+#define DZIENNIK_WIADOMOSC(...) do {} while (0)
+#endif
+
+// FIRMA------------------------------------------------------------------------
+
+void inicjujFirme(tfirma &f);
+void inicjujBenchmark(tfirma &f);
+void podlaczLiczniki(tfirma &f, tliczniki * liczniki);
+void ustawObsluge(tfirma &f);
+void uruchomFirme(tfirma &f);
+void obsluzWiadomosc(tfirma &f, int tag, tmessage &message, int source);
+void obsluzPobudke(tfirma &f);
+void wejdzDoStanu1(tfirma &f);
+void zatrzymajFirme(tfirma &f);
+void wpuscZLicznika(tfirma &f, int z, int pid, int ile);
+void obsluzZdarzenieSilnika(tfirma &f);
+
+double percentyl(const std::vector<long long> &h, long long suma, double p);
+void wypiszWyniki(tfirma &f, double czas, std::vector<long long> opoznienia[2], long long wiadomosci, long long paczki);
+
+#endif
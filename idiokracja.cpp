@@ -1,10 +1,27 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <mpi.h>
-#include <omp.h>
 #include <ctime>
 #include <vector>
+#include <deque>
+#include <list>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <sched.h>
+#include <getopt.h>
+#include <csignal>
+#include <pthread.h>
+#include <cstddef>
+#include "firma.h"
+#include "opcje.h"
+#include "nagranie.h"
 
 /*
  * Projekt IDIOKRACJA
@@ -25,757 +42,1213 @@
  * Stan 3- ubieganie sie o okno
  * Stan 4- papierkologia
  *
- * Wyrozniamy w stanach 1, 2b oraz 4 dwa watki:
- * Do komunikacji- odpowiada za komunikacje procesow ze soba
- * Do sterowania- informuje, kiedy skonczyc szukanie
+ * Cala komunikacja odbywa sie w jednym silniku protokolu, ktory przez caly
+ * czas zycia procesu odbiera wiadomosci i przekazuje je do obslugi wybranej
+ * z tablicy wg pary (stan, tag). Zmiana stanu to jedynie zmiana pola stan.
+ * Stany 2c oraz 5 sa natychmiastowe, wiec nie maja swoich wierszy w tablicy.
+ *
+ * Obok silnika przez caly czas zycia procesu dziala watek sterujacy. W stanach
+ * 1, 2b oraz 4 silnik zleca mu przez kanal polecen odliczenie czasu, a watek
+ * sterujacy ustawia flage pobudki, kiedy skonczyc czekanie. Silnik sprawdza
+ * te flage na przemian z MPI_Test, wiec pobudka nie przechodzi przez MPI
+ * i jest obslugiwana jako zdarzenie INSIDE.
+ *
+ * Wiadomosci wysylane podczas obslugi jednego zdarzenia trafiaja do paczek,
+ * osobnych dla kazdej firmy docelowej. Silnik wysyla kazda paczke jako jeden
+ * transfer MPI przed obsluga kolejnego zdarzenia, a odbiorca rozpakowuje ja
+ * i obsluguje wiadomosci po kolei wg tagu zapisanego w kazdym pakiecie.
+ *
+ * Stan firmy i obsluga zdarzen sa w firma.cpp, wspolnym z symulatorem, a tutaj
+ * jest silnik MPI, ktory dostarcza firmie funkcje z sekcji SILNIK w firma.h.
+ *
+ * Bez benchmarku firmy pracuja do zatrzymania sygnalem SIGINT, SIGTERM lub
+ * SIGUSR1, ktory mpirun przekazuje wszystkim procesom (kill -USR1 <pid mpirun>).
+ * Firma, ktora dostala sygnal, rozsyla KONIEC_PRACY. Kazda firma konczy wtedy
+ * biezaca runde, przechodzi do STAN_KONIEC i dolacza do nieblokujacej bariery,
+ * a do jej zakonczenia dalej odpowiada innym. Po barierze procesy zwalniaja
+ * zasoby i dochodza do MPI_Finalize.
  *
 */
 
-// Message Tags
-#define INSIDE           0
-#define KLINIKA_REQUEST  1
-#define KLINIKA_AGREE    2
-#define OKNO_REQUEST     3
-#define OKNO_AGREE       4
+// Format wiadomosci w sieci, zmiana ukladu pol wymaga podbicia wersji
+#define WERSJA_PAKIETU   1
+#define TAG_PACZKA       100 // Jedyny tag MPI, wlasciwy tag jest w kazdym pakiecie
+#define MAX_PACZKA       64  // Pelna paczka jest wysylana od razu
 
 typedef struct {
-    int pid; // Pole do zapamietania id procesu wysylajacego wiadomosc
-    int tim; // Pole do zapamietania zegaru Lamporta procesu wysylajacego wiadomosc
-    int val; // Pole do zapamietania wartosci dodatkowych, jak liczba idiotow dla kliniki czy czas Lamporta zadania procesu
-} tmessage;
+    unsigned char wersja; // WERSJA_PAKIETU
+    unsigned char tag;    // Tag wiadomosci, jak KLINIKA_REQUEST
+    unsigned short pid;   // Nadawca, wiec firm moze byc co najwyzej 65535 (sprawdza sprawdzOpcje)
+    int tim;
+    int val;
+} tpakiet;
+
+// Paczka wyslana przez MPI_Isend, bufor musi zyc do zakonczenia wysylki
+typedef struct {
+    std::vector<tpakiet> pakiety;
+    MPI_Request zadanie;
+} tpaczka;
+
+// Polecenie dla watku sterujacego konczace jego prace
+#define POLECENIE_KONIEC -1
 
-std::vector<tmessage> klinikainside;
-std::vector<tmessage> klinikawaiting;
-std::vector<tmessage> okienkawaiting;
+// Pierscien zapisow dziennika bez blokad. Zapisy dodaje tylko watek silnika,
+// a do pliku przenosi je tylko watek piszacy, wiec wystarcza dwa liczniki.
+#define ROZMIAR_DZIENNIKA 4096 // Potega dwojki
 
+typedef struct {
+    tzapis zapisy[ROZMIAR_DZIENNIKA];
+    std::atomic<unsigned> zapisane;  // Liczba zapisow dodanych przez silnik
+    std::atomic<unsigned> odczytane; // Liczba zapisow przeniesionych do pliku
+    std::atomic<bool> koniec;        // Silnik nie doda juz zadnego zapisu
+    FILE * plik;
+} tdziennik;
+
+// Kanal polecen od silnika do watku sterujacego
+typedef struct {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<int> polecenia; // Czas do odliczenia w ms lub POLECENIE_KONIEC
+    std::atomic<bool> pobudka; // Ustawiana przez watek sterujacy po odliczeniu czasu
+} tkanal;
 
+// Stan silnika, w kazdym procesie dziala jedna firma
+typedef struct {
+    std::vector<std::vector<tpakiet> > doWyslania; // Paczki w budowie, indeksowane id odbiorcy
+    std::vector<int> celePaczek;          // Odbiorcy z niepustymi paczkami w budowie
+    std::list<tpaczka> paczki;            // Paczki wysylane przez MPI_Isend
+    long long transfery;                  // Paczki wyslane przez MPI
+    bool konczy;                          // Czekamy na zakonczenie bariery koncowej
+    MPI_Request bariera;
+    tkanal * kanal;                       // Kanal polecen do watku sterujacego
+    tdziennik * dziennik;                 // Dziennik zdarzen firmy
+    FILE * nagranie;                      // Nagranie zdarzen do powtorki, NULL gdy nie nagrywamy
+    double czasZdarzenia;                 // Przy nagrywaniu czasSilnika() w biezacym zdarzeniu
+    std::vector<int> liderFirmy;          // Tryb wezlow: lider wezla kazdej firmy, pusty bez wezlow
+    long long pozaWezlem;                 // Tryb wezlow: wiadomosci do firm z innych wezlow
+} tsilnik;
+
+tsilnik silnik;
 
 // Program constants
-const int max_idiots   = 20; // maksymalna liczba idiotow
-const int max_wait_i   = 4; // maksymalny czas oczekiwania na idiotow
-const int max_wait_k   = 4; // maksymalny czas oczekiwania na klinike
-const int max_wait_o   = 4; // maksymalny czas oczekiwania na okienko
-
-// Program parameters
-int id,        // Id firmy / procesu
-    N,         // Liczba firm / procesow
-    K,         // Liczba miejsc w klinice
-    L;         // Liczba okienek w urzedzie
-
-// Program variables
-int idiots;    // Liczba idiotow
-int lamport;   // Zegar Lamporta, poczatkowa wartosc to 0
-int tmp_idiots;// Poprzednia liczba idiotow, jest trzymana na potrzeby wyslania wiadomosci o zwolnieniu kliniki
-
-int miejscaZajete() {
-    int res = 0;
-    if (!klinikainside.empty())
-        for (int i = 0; i < klinikainside.size(); i++) {
-            res += klinikainside.at(i).val;
-        }
-    return res;
+const int prog_aktywny   = 1000;   // liczba pustych obiegow silnika przed oddaniem procesora
+const int prog_uspienia  = 100000; // liczba pustych obiegow silnika przed krotkim uspieniem
+
+// ZATRZYMANIE------------------------------------------------------------------
+
+volatile sig_atomic_t zatrzymanie = 0; // Ustawiana przez obsluge sygnalu, sprawdza ja silnik
+
+void obsluzSygnal(int sygnal) {
+    zatrzymanie = 1;
 }
 
-// STAN 1-----------------------------------------------------------------------
+void ustawSygnaly() {
+    struct sigaction akcja;
+    memset(&akcja, 0, sizeof(akcja));
+    akcja.sa_handler = obsluzSygnal;
+    sigemptyset(&akcja.sa_mask);
+    akcja.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &akcja, NULL);
+    sigaction(SIGTERM, &akcja, NULL);
+    sigaction(SIGUSR1, &akcja, NULL);
+}
 
-// Kod watku sterujacego w stanie 1
-void state1Control() {
-    // Firma czeka az pojawia sie nowi idioci
-    sleep(rand() % max_wait_i);
+// Watki pomocnicze nie odbieraja sygnalow, wiec nie przerywaja ich usleep()
+void blokujSygnaly() {
+    sigset_t sygnaly;
+    sigemptyset(&sygnaly);
+    sigaddset(&sygnaly, SIGINT);
+    sigaddset(&sygnaly, SIGTERM);
+    sigaddset(&sygnaly, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &sygnaly, NULL);
+}
 
-    tmessage message;
-    message.pid = id;     // ID procesu, wysylamy sami do siebie
-    message.tim = -1;     // Tu normalnie zegar Lamporta, lecz wiadomosci INSIDE
-                          // korzystaja z zegaru Lamporta
-    message.val = 0;      // Nie mamy konkretnej wartosci do podeslania
-    MPI_Send(&message, 3, MPI_INT, id, INSIDE, MPI_COMM_WORLD);
-}
-
-// Kod watku komunikacyjnego w stanie 1
-void state1Communication() {
-    /*
-     * Firma w trakcie czekania na idiotow musi odpowiadac na prosby
-     * innych firm
-     */
-    MPI_Status status;
+// DZIENNIK---------------------------------------------------------------------
 
-    do {
-        tmessage recvmessage;
-        tmessage message;
-        MPI_Recv(&recvmessage, 3, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        switch (status.MPI_TAG) {
-        case KLINIKA_REQUEST:  // nie ubiegamy sie o sekcje, wiec od razu wysylamy AGREE
-            printf("%d %d : Firma <%d> oczekuje na idiotow, otrzymala wiadomosc KLINIKA_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim; // aktualizujemy zegar Lamporta po odebraniu wiadomosci
-            lamport++;
-            klinikainside.push_back(recvmessage); // dodajemy firme do listy obecnych w firmie
-            message.pid = id;
-            message.tim = lamport;
-            message.val = 0;
-            lamport++;
-            MPI_Send(&message, 3, MPI_INT, status.MPI_SOURCE, KLINIKA_AGREE, MPI_COMM_WORLD);  // Wysylamy wiadomosc KLINIKA_AGREE, bo nie ubiegamy sie o klinike
-            printf("%d %d : Firma <%d> oczekuje na idiotow, wysyla wiadomosc KLINIKA_AGREE do %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            break;
-        case OKNO_REQUEST:     // nie ubiegamy sie o sekcje, wiec od razu wysylamy AGREE
-            printf("%d %d : Firma <%d> oczekuje na idiotow, otrzymala wiadomosc OKNO_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            message.pid = id;
-            message.tim = lamport;
-            message.val = recvmessage.val;  // Wysylamy rowniez zegar Lamporta, z ktorym wysylano nam OKNO_REQUEST
-            lamport++;
-            MPI_Send(&message, 3, MPI_INT, status.MPI_SOURCE, OKNO_AGREE, MPI_COMM_WORLD); // Wysylamy wiadomosc OKNO_AGREE, bo nie ubiegamy sie o okna
-            printf("%d %d : Firma <%d> oczekuje na idiotow, wysyla wiadomosc OKNO_AGREE do %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            break;
-        case KLINIKA_AGREE:   // musimy czyscic nasza liste zapamietanych procesow w klinice, aby uniknac bledow
-            printf("%d %d : Firma <%d> otrzymala wiadomosc KLINIKA_AGREE zwalniajaca miejsce %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            if (recvmessage.val > 0) { //Jezeli ktos zwalnia miejsce w klinice i wysyla nam zgode, to musimy go usunac z naszej listy obecnych w klinice
-                int i = 0;
-                if (!klinikainside.empty()) {
-                    while (i < klinikainside.size() && klinikainside.at(i).pid != recvmessage.pid) i++;
-                    if (i < klinikainside.size()) klinikainside.erase(klinikainside.begin()+i);
-                }
-            }
-            break;
-        default:
-            if (status.MPI_TAG != INSIDE) { // Gdy dostajemy jakies przestarzale wiadomosci, bez ladu i skladu to jedynie aktualizujemy zegar
-                lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-                lamport++;
-            }
-        }
-    } while (status.MPI_TAG != INSIDE);
-    idiots = 0;
-    while (idiots == 0) idiots = rand() % max_idiots; // Tutaj przychodza idioci do firmy
-    printf("%d %d : Firma <%d> otrzymala %d idiotow\n", lamport, id, id, idiots);
+// MPI_Wtime() w Open MPI liczy czas od startu procesu, wiec do scalania
+// dziennikow wielu firm potrzebny jest zegar wspolny dla wszystkich
+double czasRzeczywisty() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
-// STAN 2a----------------------------------------------------------------------
+// Dodaje zapis do pierscienia, przy pelnym pierscieniu czeka na watek piszacy
+void zapisz(tfirma &f, int zdarzenie, int tag, int peer, int a, int b, int c, int d) {
+    tdziennik * dz = silnik.dziennik;
+    unsigned i = dz->zapisane.load(std::memory_order_relaxed);
+    while (i - dz->odczytane.load(std::memory_order_acquire) == ROZMIAR_DZIENNIKA)
+        sched_yield();
+    tzapis &z = dz->zapisy[i & (ROZMIAR_DZIENNIKA - 1)];
+    z.czas = czasRzeczywisty();
+    z.lamport = f.lamport;
+    z.id = f.id;
+    z.stan = f.stan;
+    z.zdarzenie = zdarzenie;
+    z.tag = tag;
+    z.zapas = 0;
+    z.peer = peer;
+    z.val[0] = a;
+    z.val[1] = b;
+    z.val[2] = c;
+    z.val[3] = d;
+    dz->zapisane.store(i + 1, std::memory_order_release);
+}
 
-void state2aCommunication() {  // Ten stan wymaga tylko komunikacji
+// Przenosi zapisy z pierscienia do pliku, dopoki silnik nie skonczy pracy
+void watekPiszacy(tdziennik * dz) {
+    blokujSygnaly();
+    while (1) {
+        bool koniec = dz->koniec.load(std::memory_order_acquire);
+        unsigned od = dz->odczytane.load(std::memory_order_relaxed);
+        unsigned zapisane = dz->zapisane.load(std::memory_order_acquire);
+        if (od == zapisane) {
+            if (koniec) break;
+            usleep(1000);
+            continue;
+        }
+        while (od != zapisane) {
+            unsigned poczatek = od & (ROZMIAR_DZIENNIKA - 1);
+            unsigned ile = zapisane - od;
+            if (ile > ROZMIAR_DZIENNIKA - poczatek) ile = ROZMIAR_DZIENNIKA - poczatek;
+            fwrite(&dz->zapisy[poczatek], sizeof(tzapis), ile, dz->plik);
+            od += ile;
+            dz->odczytane.store(od, std::memory_order_release);
+        }
+        fflush(dz->plik); // Dziennik ma byc czytelny takze po przerwaniu programu
+    }
+}
 
-    /*
-     * Ta funkcja odpowiada za stan, w ktorym firma ubiega sie o dostep do kliniki.
-     * Zatem, gdy odbieramy wiadomosc:
-     * -KLINIKA_REQUEST, to porownujemy priorytet i albo uznajemy,ze mamy wiekszy
-     *   i automatycznie uznajemy swoje prawo do sekcji wzgledem tamtego procesu,
-     *   i inkrementujemy licznik zgod
-     *   LUB widzimy, ze mamy mniejszy priorytet i ustepujemy temu procesowi
-     * -KLINIKA_AGREE, to inkrementujemy licznik zgod
-     * -OKNO_REQUEST, to dajemy zgode
-     *
-    */
+// Otwiera plik <prefiks>.<id>.bin i zapisuje jego naglowek
+bool otworzDziennik(tdziennik * dz, const char * prefiks, int id, int N) {
+    char nazwa[256];
+    snprintf(nazwa, sizeof(nazwa), "%s.%d.bin", prefiks, id);
+    dz->plik = fopen(nazwa, "wb");
+    if (dz->plik == NULL) return false;
+    tnaglowekDziennika naglowek = {{'I', 'D', 'Z', 'D'}, WERSJA_DZIENNIKA, id, N};
+    fwrite(&naglowek, sizeof(naglowek), 1, dz->plik);
+    dz->zapisane = 0;
+    dz->odczytane = 0;
+    dz->koniec = false;
+    return true;
+}
 
-    MPI_Status status;
+// LICZNIKI---------------------------------------------------------------------
+
+// Liczniki firmy we wspoldzielonej pamieci, aby mozna je bylo czytac w trakcie pracy
+tliczniki * otworzLiczniki(int id) {
+    char nazwa[64];
+    snprintf(nazwa, sizeof(nazwa), NAZWA_LICZNIKOW, id);
+    int fd = shm_open(nazwa, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, sizeof(tliczniki)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    void * p = mmap(NULL, sizeof(tliczniki), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? NULL : (tliczniki *) p;
+}
 
-    lamport++;    //Inkrementacja zegara Lamporta przed wyslaniem broadcastu
+void zamknijLiczniki(tliczniki * liczniki, int id) {
+    char nazwa[64];
+    snprintf(nazwa, sizeof(nazwa), NAZWA_LICZNIKOW, id);
+    munmap(liczniki, sizeof(tliczniki));
+    shm_unlink(nazwa);
+}
 
-    tmessage request;
-    request.pid = id;      // Nasze id, potrzebne do priorytetu
-    request.tim = lamport; // Nasz zegar
-    request.val = idiots;  // Ilu idiotow chcemy oddac do badan
+// WYSYLANIE--------------------------------------------------------------------
 
-    int lamportonrequest = lamport;
+MPI_Datatype typPakietu; // Typ pochodny MPI opisujacy tpakiet
 
-    for (int i = 0; i < N; i++) { // Wysylamy do kazdego KLINIKA_REQUEST, z wyjatkiem siebie samego
-        if (i != id) {
-            MPI_Send(&request, 3, MPI_INT, i, KLINIKA_REQUEST, MPI_COMM_WORLD);
-        }
+void zbudujTypPakietu() {
+    int dlugosci[5] = {1, 1, 1, 1, 1};
+    MPI_Aint przesuniecia[5] = {offsetof(tpakiet, wersja), offsetof(tpakiet, tag), offsetof(tpakiet, pid),
+                                offsetof(tpakiet, tim), offsetof(tpakiet, val)};
+    MPI_Datatype typy[5] = {MPI_UNSIGNED_CHAR, MPI_UNSIGNED_CHAR, MPI_UNSIGNED_SHORT, MPI_INT, MPI_INT};
+    MPI_Datatype typ;
+    MPI_Type_create_struct(5, dlugosci, przesuniecia, typy, &typ);
+    MPI_Type_create_resized(typ, 0, sizeof(tpakiet), &typPakietu); // Tablica pakietow bez przerw
+    MPI_Type_free(&typ);
+    MPI_Type_commit(&typPakietu);
+}
+
+// Wysyla paczke dla jednego odbiorcy i oproznia jej bufor
+void wyslijPaczke(tfirma &f, int cel) {
+    std::vector<tpakiet> &bufor = silnik.doWyslania[cel];
+    if (cel != f.monitor) silnik.transfery++;
+    if (f.rozsylanieBlokujace) {
+        MPI_Send(bufor.data(), bufor.size(), typPakietu, cel, TAG_PACZKA, MPI_COMM_WORLD);
+        bufor.clear();
+        return;
     }
+    silnik.paczki.push_back(tpaczka());
+    tpaczka &p = silnik.paczki.back();
+    p.pakiety.swap(bufor);
+    MPI_Isend(p.pakiety.data(), p.pakiety.size(), typPakietu, cel, TAG_PACZKA, MPI_COMM_WORLD, &p.zadanie);
+}
 
-    printf("%d %d : Firma <%d> wyslala broadcast KLINIKA_REQUEST\n", lamport, id, id);
+// Wysyla wszystkie paczki zebrane podczas obslugi zdarzenia
+void wyslijPaczki(tfirma &f) {
+    for (int i = 0; i < silnik.celePaczek.size(); i++)
+        if (!silnik.doWyslania[silnik.celePaczek[i]].empty())
+            wyslijPaczke(f, silnik.celePaczek[i]);
+    silnik.celePaczek.clear();
+}
 
-    int agreements = 0;
+// Dodaje wiadomosc do paczki dla odbiorcy, pelna paczke wysyla od razu
+void nadaj(tfirma &f, int cel, int tag, tmessage &message) {
+    std::vector<tpakiet> &bufor = silnik.doWyslania[cel];
+    if (!silnik.liderFirmy.empty() && cel != f.monitor && silnik.liderFirmy[cel] != silnik.liderFirmy[f.id])
+        silnik.pozaWezlem++;
+    if (bufor.empty()) silnik.celePaczek.push_back(cel);
+    tpakiet pakiet;
+    pakiet.wersja = WERSJA_PAKIETU;
+    pakiet.tag = tag;
+    pakiet.pid = message.pid;
+    pakiet.tim = message.tim;
+    pakiet.val = message.val;
+    bufor.push_back(pakiet);
+    if (bufor.size() == MAX_PACZKA) wyslijPaczke(f, cel);
+}
 
-    bool * agree = new bool[N];
+// Zwalnia bufory paczek, ktorych MPI_Isend juz sie zakonczyl
+void postepRozsylania(tfirma &f) {
+    std::list<tpaczka>::iterator it = silnik.paczki.begin();
+    while (it != silnik.paczki.end()) {
+        int gotowe;
+        MPI_Test(&it->zadanie, &gotowe, MPI_STATUS_IGNORE);
+        if (gotowe)
+            it = silnik.paczki.erase(it);
+        else
+            ++it;
+    }
+}
 
-    for (int i = 0; i < N; i++) agree[i] = false;
+// STEROWANIE------------------------------------------------------------------
 
-    do {
-        tmessage recvmessage;
-        tmessage message;
-        MPI_Recv(&recvmessage, 3, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        switch (status.MPI_TAG) {
-        case KLINIKA_REQUEST:  // ubiegamy sie o sekcje, AGREE zalezy od priorytetu
-            printf("%d %d : Firma <%d> oczekuje na klinike, otrzymala wiadomosc KLINIKA_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            // Nalezy podjac decyzje, kto ma pierwszenstwo do kliniki
-            if ((lamportonrequest < recvmessage.tim) || ((lamportonrequest == recvmessage.tim) && (id < recvmessage.pid))) {
-                // Mam pierwszenstwo do kliniki
-                klinikawaiting.push_back(recvmessage); // Dodaje zatem firme proszaca do listy firm, do ktorych po zakonczeniu wysle ZGODE
-                printf("%d %d : Firma <%d> oczekuje na klinike, otrzymuje pierwszenstwo przed %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-                if (!agree[recvmessage.pid]) { // Jezeli nie otrzymalem dotychczas zgody od tego procesu, to inkrementuje licznik zgod
-                    agreements++;
-                    agree[recvmessage.pid] = true;
-                    printf("%d %d : Firma <%d> ma juz %d KLINIKA_AGREE\n", lamport, id, id, agreements);
-                }
-            }
-            else {
-                klinikainside.push_back(recvmessage);  // W przeciwnym razie on ma pierwszenstwo, wiec zapamietuje go w liscie tych, co sa w klinice
-                printf("%d %d : Firma <%d> oczekuje na klinike, nie ma pierwszenstwa przed %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            }
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            break;
-        case OKNO_REQUEST:     // nie ubiegamy sie o sekcje, wiec od razu wysylamy AGREE
-            printf("%d %d : Firma <%d> oczekuje na klinike, otrzymala wiadomosc OKNO_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            lamport++;
-            message.pid = id;
-            message.tim = lamport;
-            message.val = recvmessage.val;
-            MPI_Send(&message, 3, MPI_INT, status.MPI_SOURCE, OKNO_AGREE, MPI_COMM_WORLD);
-            printf("%d %d : Firma <%d> oczekuje na klinike, wysyla wiadomosc OKNO_AGREE do %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            break;
-        case KLINIKA_AGREE:   // gdy otrzymujemy zgode, to inkrementujemy licznik zgod
-            printf("%d %d : Firma <%d> oczekuje na klinike, otrzymala wiadomosc KLINIKA_AGREE %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            if (recvmessage.val > 0) { //Jezeli ktos zwalnia miejsce w klinice i wysyla nam zgode, to musimy go usunac z naszej listy obecnych w klinice
-                if (!klinikainside.empty()) {
-                    int i = 0;
-                    while (i < klinikainside.size() && klinikainside.at(i).pid != recvmessage.pid) i++;
-                    if (i < klinikainside.size()) {
-                        klinikainside.erase(klinikainside.begin()+i);
-                        printf("%d %d : Firma <%d> oczekuje na klinike, usuwa z listy obecnych w klinice %d\n", lamport, id, id, recvmessage.pid);
-                    }
-                }
-            }
-            if (!agree[recvmessage.pid]) {
-                agreements++;
-                agree[recvmessage.pid] = true;
-                printf("%d %d : Firma <%d> ma juz %d KLINIKA_AGREE\n", lamport, id, id, agreements);
-            }
-            break;
-        default:
-            if (status.MPI_TAG != INSIDE) {
-                lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-                lamport++;
-            }
+void zlecPolecenie(tkanal * kanal, int polecenie) {
+    std::lock_guard<std::mutex> lck(kanal->mtx);
+    kanal->polecenia.push_back(polecenie);
+    kanal->cv.notify_one();
+}
+
+// Kod watku sterujacego, dziala przez caly czas zycia procesu
+void watekSterujacy(tkanal * kanal) {
+    blokujSygnaly();
+    while (1) {
+        int czas;
+        {
+            std::unique_lock<std::mutex> lck(kanal->mtx);
+            while (kanal->polecenia.empty()) kanal->cv.wait(lck);
+            czas = kanal->polecenia.front();
+            kanal->polecenia.pop_front();
         }
-    } while ((agreements < N - 1));// || (miejscaZajete() >= K));
+        if (czas == POLECENIE_KONIEC) break;
+
+        // Firma czeka na idiotow, przebywa w klinice lub realizuje papierkologie
+        if (czas > 0) usleep(czas * 1000);
 
-    tmp_idiots = idiots;
+        kanal->pobudka.store(true, std::memory_order_release);
+    }
+}
 
-    idiots = (idiots - (K - miejscaZajete())) > 0 ? (idiots - (K - miejscaZajete())) : 0;
+void odliczCzas(tfirma &f, int ms) {
+    zlecPolecenie(silnik.kanal, ms);
+}
 
-    printf("%d %d : Firma <%d> widzi %d miejsc zajetych, otrzymala dostep do kliniki z %d idiotami, przetworzymy ich %d\n", lamport, id, id, miejscaZajete(), tmp_idiots, tmp_idiots < (K - miejscaZajete()) ? tmp_idiots : (K - miejscaZajete()));
+// Przy nagrywaniu czas nie plynie w trakcie zdarzenia, aby powtorka widziala ten sam
+double czasSilnika() {
+    return silnik.nagranie != NULL ? silnik.czasZdarzenia : MPI_Wtime();
+}
 
-    klinikainside.push_back(request);
+// NAGRANIE---------------------------------------------------------------------
+
+bool otworzNagranie(const char * prefiks, tfirma &f, unsigned ziarno) {
+    char nazwa[300];
+    snprintf(nazwa, sizeof(nazwa), "%s.%d.bin", prefiks, f.id);
+    silnik.nagranie = fopen(nazwa, "wb");
+    if (silnik.nagranie == NULL) return false;
+    setvbuf(silnik.nagranie, NULL, _IOFBF, 1 << 20);
+
+    tnaglowekNagrania n;
+    memset(&n, 0, sizeof(n));
+    memcpy(n.magia, "IDZN", 4);
+    n.wersja = WERSJA_NAGRANIA;
+    n.id = f.id;
+    n.N = f.N;
+    n.K = f.K;
+    n.L = f.L;
+    n.monitor = f.monitor;
+    n.trybKliniki = f.trybKliniki;
+    n.trybOkna = f.trybOkna;
+    n.maxIdiotow = f.maxIdiotow;
+    n.czasIdiotow = f.czasIdiotow;
+    n.czasKliniki = f.czasKliniki;
+    n.czasOkna = f.czasOkna;
+    n.maxRund = f.maxRund;
+    n.ziarno = ziarno;
+    n.benchmark = f.benchmark;
+    n.czasStartu = f.czasStartu;
+    n.czasKonca = f.czasKonca;
+    fwrite(&n, sizeof(n), 1, silnik.nagranie);
+    return true;
+}
 
-    delete [] agree;
+// Zapisuje zdarzenie przed przekazaniem go firmie i zatrzymuje dla niej czas
+void nagraj(int rodzaj, int tag, int zrodlo, const tmessage &m) {
+    if (silnik.nagranie == NULL) return;
+    tzdarzenieNagrania z;
+    silnik.czasZdarzenia = MPI_Wtime();
+    z.czas = silnik.czasZdarzenia;
+    z.rodzaj = rodzaj;
+    z.tag = tag;
+    z.zrodlo = zrodlo;
+    z.pid = m.pid;
+    z.tim = m.tim;
+    z.val = m.val;
+    fwrite(&z, sizeof(z), 1, silnik.nagranie);
 }
 
-// STAN 2b----------------------------------------------------------------------
+// LICZNIKI RMA-----------------------------------------------------------------
 
-// Kod watku sterujacego w stanie 2b
-void state2bControl() {
-    // Firma czeka az pojawia sie nowi idioci
-    sleep(rand() % max_wait_k);
+/*
+ * W trybie licznikow (-a) wolne miejsca w klinice leza w oknie RMA firmy 0,
+ * a wolne okienka w oknie firmy 1, wiec oba liczniki nie obciazaja jednej
+ * firmy. Stan licznika to jedno slowo 64-bitowe: wolne jednostki, bilet
+ * nastepnego czekajacego i bilet obslugiwanego, zmieniane przez
+ * MPI_Compare_and_swap i MPI_Fetch_and_op. Za slowem jest zegar ostatniego
+ * zwolnienia dla monitora i kolejka FIFO czekajacych, wpis na kazdy bilet.
+ *
+ * Firma zaklada, ze slowo ma wartosc z jej ostatniej operacji, wiec gdy nikt
+ * inny go w miedzyczasie nie zmienil, zajecie to jedno MPI_Compare_and_swap.
+ * Inaczej CAS zwraca biezace slowo i firma probuje z nim jeszcze raz. Gdy
+ * ktos czeka albo nic nie jest wolne, firma bierze bilet, zapisuje swoj wpis
+ * w kolejce i sama probuje wpuszczac. Wpuszcza kazdy, kto zwolnil jednostki
+ * lub zapisal wpis: dopoki na poczatku kolejki jest zapisany wpis, a cos jest
+ * wolne, CAS przesuwa bilet obslugiwanego razem z odjeciem jednostek,
+ * a wpuszczona firma dostaje LICZNIK_WPUSZCZENIE. Wpis niezapisany jeszcze
+ * przez czekajacego wpusci on sam, bo po zapisie czyta slowo od nowa.
+ *
+ * Open MPI 4.1 z domyslnym osc rdma na btl vader pada przy operacjach
+ * atomowych na jednym wezle, wtedy uruchamiamy z osc sm albo ucx:
+ *
+ *     mpirun --mca osc sm -np 4 ./idiokracja.out -a -r 100 8 2
+ *
+*/
 
-    tmessage message;
-    message.pid = id;     // ID procesu, wysylamy sami do siebie
-    message.tim = -1;     // Tu normalnie zegar Lamporta, lecz wiadomosci INSIDE
-                          // korzystaja z zegaru Lamporta
-    message.val = 0;      // Nie mamy konkretnej wartosci do podeslania
-    MPI_Send(&message, 3, MPI_INT, id, INSIDE, MPI_COMM_WORLD);
-}
+#define LICZNIK_SLOWO    0 // Przesuniecia w oknie licznika, w slowach 64-bitowych
+#define LICZNIK_ZEGAR    1
+#define LICZNIK_KOLEJKA  2
+#define WPIS_ZAPISANY    0x10000ULL // Odroznia zapisany wpis z biletem 0 od pustego
 
-void state2bCommunication() {
-    MPI_Status status;
+typedef unsigned long long tslowo;
 
-    do {
-        tmessage recvmessage;
-        tmessage message;
-        MPI_Recv(&recvmessage, 3, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        switch (status.MPI_TAG) {
-        case KLINIKA_REQUEST:  // Jestesmy w klinice, zatem najpierw sprawdzamy, czy wg nas jest miejsce w klinice i wtedy wysylamy wiadomosc
-            printf("%d %d : Firma <%d> jest w klinice, otrzymala wiadomosc KLINIKA_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            if (miejscaZajete() < K) { // Jezeli wiemy, ze sa wolne miejsca w klinice, to wysylamy zgode
-                klinikainside.push_back(recvmessage);
-                lamport++;
-                message.pid = id;
-                message.tim = lamport;
-                message.val = 0;
-                MPI_Send(&message, 3, MPI_INT, status.MPI_SOURCE, KLINIKA_AGREE, MPI_COMM_WORLD);
-                printf("%d %d : Firma <%d> jest w klinice, jest %d zajetych, wysyla wiadomosc KLINIKA_AGREE do %d %d\n", lamport, id, id, miejscaZajete(), recvmessage.tim, recvmessage.pid);
-            }
-            else { // Jezeli nie ma miejsc w klinice, to nie wysylamy zgody do proszacych, tylko zapamietujemy ich w klinika waiting
-                klinikawaiting.push_back(recvmessage);
-                printf("%d %d : Firma <%d> jest w klinice, jest %d zajetych, w ktorej nie ma miejsca, wiec nie wysyla AGREE do %d %d\n", lamport, id, id, miejscaZajete(), recvmessage.tim, recvmessage.pid);
-            }
-            break;
-        case OKNO_REQUEST:     // nie ubiegamy sie o sekcje, wiec od razu wysylamy AGREE
-            printf("%d %d : Firma <%d> jest w klinice, otrzymala wiadomosc OKNO_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            lamport++;
-            message.pid = id;
-            message.tim = lamport;
-            message.val = recvmessage.val;
-            MPI_Send(&message, 3, MPI_INT, status.MPI_SOURCE, OKNO_AGREE, MPI_COMM_WORLD);
-            printf("%d %d : Firma <%d> jest w klinice, wysyla wiadomosc OKNO_AGREE do %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            break;
-        case KLINIKA_AGREE:   // gdy otrzymujemy informacje o opuszczeniu przez jedna z firm
-            printf("%d %d : Firma <%d> jest w klinice, otrzymala wiadomosc KLINIKA_AGREE %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            if (recvmessage.val > 0) { // Jezeli ktos zwalnia miejsce w klinice i wysyla nam zgode, to musimy go usunac z naszej listy obecnych w klinice
-                int i = 0;
-                if (!klinikainside.empty()) {
-                    while (i < klinikainside.size() && klinikainside.at(i).pid != recvmessage.pid) i++;
-                    if (i < klinikainside.size()) klinikainside.erase(klinikainside.begin()+i);
-                }
-                if (miejscaZajete() < K) { // Skoro miejsce sie zwolnilo, i mamy jakies miejsce wg nas w klinice, to wysylamy KLINIKA_AGREE do skolejkowanych
-                    lamport++;
-                    for (int j = 0; j < klinikawaiting.size(); j++) {
-                        tmessage placefree;
-                        placefree.pid = id;
-                        placefree.tim = lamport;
-                        placefree.val = 0;
-                        MPI_Send(&placefree, 3, MPI_INT, klinikawaiting.at(j).pid, KLINIKA_AGREE, MPI_COMM_WORLD);
-                        klinikainside.push_back(klinikawaiting.at(j));
-                    }
-                    klinikawaiting.clear();
-                }
-            }
-            break;
-        default:
-            if (status.MPI_TAG != INSIDE) {
-                lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-                lamport++;
-            }
-        }
-    } while (status.MPI_TAG != INSIDE);
+typedef struct {
+    MPI_Win okno;
+    tslowo * pamiec;       // Nasza czesc okna, pusta poza firmami domowymi
+    int dom[2];            // Firma trzymajaca licznik zasobu
+    int wpisy;             // Dlugosc kolejki, potega dwojki co najmniej N
+    tslowo znane[2];       // Slowo licznika po naszej ostatniej operacji
+    long long operacje;    // Operacje atomowe na oknie
+} tlicznikiRma;
+
+tlicznikiRma rma;
+
+inline tslowo slowoLicznika(unsigned wolne, unsigned bilet, unsigned obslugiwany) {
+    return (tslowo) (obslugiwany & 0xFFFF) << 48 | (tslowo) (bilet & 0xFFFF) << 32 | wolne;
+}
+inline unsigned wolneLicznika(tslowo s)      { return (unsigned) (s & 0xFFFFFFFFULL); }
+inline unsigned biletLicznika(tslowo s)      { return (unsigned) (s >> 32) & 0xFFFF; }
+inline unsigned obslugiwanyLicznika(tslowo s) { return (unsigned) (s >> 48); }
+
+// Przesuniecie pola licznika zasobu z w oknie firmy domowej
+MPI_Aint polaLicznika(int z, int pole) {
+    int poczatek = rma.dom[0] == rma.dom[1] ? z * (LICZNIK_KOLEJKA + rma.wpisy) : 0;
+    return poczatek + pole;
 }
 
-// STAN 2c----------------------------------------------------------------------
+MPI_Aint wpisLicznika(int z, unsigned bilet) {
+    return polaLicznika(z, LICZNIK_KOLEJKA) + (bilet & (rma.wpisy - 1));
+}
 
-void state2cCommunication() {
-    tmessage leave;
+tslowo rmaCas(int z, MPI_Aint pole, tslowo nowe, tslowo oczekiwane) {
+    tslowo stare;
+    MPI_Compare_and_swap(&nowe, &oczekiwane, &stare, MPI_UNSIGNED_LONG_LONG, rma.dom[z], pole, rma.okno);
+    MPI_Win_flush(rma.dom[z], rma.okno);
+    rma.operacje++;
+    return stare;
+}
 
-    lamport++;
-    leave.pid = id;          // Nasze id, potrzebne do priorytetu
-    leave.tim = lamport;     // Nasz zegar
-    leave.val = tmp_idiots;  // Wartosc jest konieczna, poniewaz gdy val == 0 to procesy nie usuwaja procesu z listy firm wewnatrz kliniki
+tslowo rmaOperacja(int z, MPI_Aint pole, tslowo wartosc, MPI_Op op) {
+    tslowo stare;
+    MPI_Fetch_and_op(&wartosc, &stare, MPI_UNSIGNED_LONG_LONG, rma.dom[z], pole, op, rma.okno);
+    MPI_Win_flush(rma.dom[z], rma.okno);
+    rma.operacje++;
+    return stare;
+}
 
-    for (int i = 0; i < N; i++)
-        if (i!=id) {
-            MPI_Send(&leave, 3, MPI_INT, i, KLINIKA_AGREE, MPI_COMM_WORLD);
-        }
+// Tryb monitora: zajecie musi miec zegar wiekszy niz zwolnienie, z ktorego pochodza jednostki
+void dogonZegarLicznika(tfirma &f, int z) {
+    if (f.monitor < 0) return;
+    int zegar = (int) rmaOperacja(z, polaLicznika(z, LICZNIK_ZEGAR), 0, MPI_NO_OP);
+    if (zegar >= f.lamport) f.lamport = zegar + 1;
+}
 
-    /*
-    if (!klinikawaiting.empty()) {
-        for (int i = 0; i < klinikawaiting.size(); i++) {
-            MPI_Send(&leave, 3, MPI_INT, klinikawaiting.at(i).pid, KLINIKA_AGREE, MPI_COMM_WORLD);
-            printf("%d %d : Firma <%d> opuszcza klinike, wysyla zgode do skolejkowanego %d %d\n", lamport, id, id, klinikawaiting.at(i).tim, klinikawaiting.at(i).pid);
-        }
+// Wpuszcza czekajacych z poczatku kolejki, dopoki sa zapisani i cos jest wolne
+void wpuszczajCzekajacych(tfirma &f, int z) {
+    while (1) {
+        tslowo s = rma.znane[z];
+        unsigned wolne = wolneLicznika(s), obslugiwany = obslugiwanyLicznika(s);
+        if (biletLicznika(s) == obslugiwany || wolne == 0) return;
+        tslowo wpis = rmaOperacja(z, wpisLicznika(z, obslugiwany), 0, MPI_NO_OP);
+        if ((wpis >> 32) != (WPIS_ZAPISANY | obslugiwany)) return;
+        unsigned ile = (unsigned) (wpis & 0xFFFF);
+        if (ile > wolne) ile = wolne;
+        tslowo nowe = slowoLicznika(wolne - ile, biletLicznika(s), obslugiwany + 1);
+        tslowo stare = rmaCas(z, polaLicznika(z, LICZNIK_SLOWO), nowe, s);
+        rma.znane[z] = stare == s ? nowe : stare;
+        if (stare != s) continue;
+        dogonZegarLicznika(f, z);
+        wpuscZLicznika(f, z, (int) ((wpis >> 16) & 0xFFFF), (int) ile);
     }
+}
 
-    int fieldtoremove;
-    for (int i = 0; i < klinikainside.size(); i++) {
-        if (klinikainside.at(i).pid != id) {
-            MPI_Send(&leave, 3, MPI_INT, klinikainside.at(i).pid, KLINIKA_AGREE, MPI_COMM_WORLD);
-            printf("%d %d : Firma <%d> opuszcza klinike, wysyla zgode do obecnego w klinice %d %d\n", lamport, id, id, klinikainside.at(i).tim, klinikainside.at(i).pid);
-        } else {
-            fieldtoremove = i;
+int zajmijLicznikRma(tfirma &f, int z, int ile) {
+    if (ile > 0xFFFF) ile = 0xFFFF; // Tyle miesci wpis kolejki, reszta idiotow poczeka na kolejna runde w klinice
+    MPI_Aint pole = polaLicznika(z, LICZNIK_SLOWO);
+    while (1) {
+        tslowo s = rma.znane[z];
+        unsigned wolne = wolneLicznika(s), bilet = biletLicznika(s), obslugiwany = obslugiwanyLicznika(s);
+        int bierze = 0;
+        tslowo nowe;
+        if (bilet == obslugiwany && wolne > 0) {
+            bierze = (unsigned) ile < wolne ? ile : (int) wolne;
+            nowe = s - bierze;
         }
-    }
-    klinikainside.erase(klinikainside.begin() + fieldtoremove);
-
-    for (int i = 0; i < klinikawaiting.size(); i++) {
-        klinikainside.push_back(klinikawaiting.at(i));
-    }
-
-    klinikawaiting.clear();
-    */
-
-    int fieldtoremove;
-    for (int i = 0; i < klinikainside.size(); i++) {
-        if (klinikainside.at(i).pid != id) {
-            //MPI_Send(&leave, 3, MPI_INT, klinikainside.at(i).pid, KLINIKA_AGREE, MPI_COMM_WORLD);
-            //printf("%d %d : Firma <%d> opuszcza klinike, wysyla zgode do obecnego w klinice %d %d\n", lamport, id, id, klinikainside.at(i).tim, klinikainside.at(i).pid);
-        } else {
-            fieldtoremove = i;
+        else
+            nowe = slowoLicznika(wolne, bilet + 1, obslugiwany);
+        tslowo stare = rmaCas(z, pole, nowe, s);
+        rma.znane[z] = stare == s ? nowe : stare;
+        if (stare != s) continue;
+        if (bierze > 0) {
+            dogonZegarLicznika(f, z);
+            return bierze;
         }
+
+        // Mamy bilet, zapisujemy wpis i czytamy slowo od nowa, bo zwalniajacy mogl nie widziec wpisu
+        tslowo wpis = (WPIS_ZAPISANY | bilet) << 32 | (tslowo) f.id << 16 | (tslowo) ile;
+        rmaOperacja(z, wpisLicznika(z, bilet), wpis, MPI_REPLACE);
+        rma.znane[z] = rmaOperacja(z, pole, 0, MPI_NO_OP);
+        wpuszczajCzekajacych(f, z);
+        return 0;
     }
+}
 
-    klinikainside.erase(klinikainside.begin() + fieldtoremove);
+void zwolnijLicznikRma(tfirma &f, int z, int ile) {
+    if (f.monitor >= 0) rmaOperacja(z, polaLicznika(z, LICZNIK_ZEGAR), f.lamport, MPI_MAX);
+    rma.znane[z] = rmaOperacja(z, polaLicznika(z, LICZNIK_SLOWO), ile, MPI_SUM) + ile;
+    wpuszczajCzekajacych(f, z);
+}
 
-    for (int i = 0; i < klinikawaiting.size(); i++) {
-        klinikainside.push_back(klinikawaiting.at(i));
+// Tworzy okno licznikow, wywoluja je wszystkie procesy, takze monitor
+void otworzLicznikiRma(tfirma &f) {
+    rma.dom[ZASOB_KLINIKA] = 0;
+    rma.dom[ZASOB_OKNO] = 1 % f.N;
+    rma.wpisy = 1;
+    while (rma.wpisy < f.N) rma.wpisy *= 2;
+    rma.operacje = 0;
+    int limit[2] = {f.K, f.L};
+    int liczniki = 0;
+    for (int z = 0; z < 2; z++) {
+        rma.znane[z] = slowoLicznika(limit[z], 0, 0);
+        if (rma.dom[z] == f.id) liczniki++;
     }
+    MPI_Aint rozmiar = (MPI_Aint) liczniki * (LICZNIK_KOLEJKA + rma.wpisy) * sizeof(tslowo);
+    MPI_Win_allocate(rozmiar, sizeof(tslowo), MPI_INFO_NULL, MPI_COMM_WORLD, &rma.pamiec, &rma.okno);
+    if (rozmiar > 0) memset(rma.pamiec, 0, rozmiar);
+    for (int z = 0; z < 2; z++)
+        if (rma.dom[z] == f.id)
+            rma.pamiec[polaLicznika(z, LICZNIK_SLOWO)] = rma.znane[z];
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, rma.okno);
+    MPI_Win_sync(rma.okno);
+    MPI_Barrier(MPI_COMM_WORLD); // Liczniki sa gotowe, zanim ktokolwiek ich uzyje
+}
 
-    klinikawaiting.clear();
-
-    printf("%d %d : Firma <%d> rozeslala informacje o wyjsciu do pozostalych firm\n", lamport, id, id);
+void zamknijLicznikiRma() {
+    MPI_Win_unlock_all(rma.okno);
+    MPI_Win_free(&rma.okno);
 }
 
-// STAN 3-----------------------------------------------------------------------
+// WEZLY------------------------------------------------------------------------
 
-void state3Communication() {
+/*
+ * W trybie wezlow (-H) o klinike i okienka w trybie Ricarta nie ubiegaja sie
+ * wszystkie firmy. Procesy ze wspolna pamiecia tworza wezel (MPI_Comm_split_type
+ * z MPI_COMM_TYPE_SHARED, a przy -H n po n kolejnych procesow), a firma
+ * o najmniejszym id jest jego liderem. Firma wpisuje do swojego miejsca we
+ * wspoldzielonym oknie MPI-3 lidera, ile jednostek zasobu chce i ile oddaje,
+ * a lider przeglada te miejsca w kazdym obiegu silnika i ustawia chetne firmy
+ * w kolejce wezla.
+ *
+ * O jednostki dla calej kolejki lider ubiega sie u liderow innych wezlow
+ * algorytmem Ricarta-Agrawali z liczba jednostek, jak w semaforze wazonym:
+ * WEZEL_AGREE niesie jednostki trzymane przez wezel nadawcy, a WEZEL_RELEASE
+ * ich nowa liczbe. Ze zgodami wszystkich liderow lider zajmuje tyle wolnych
+ * jednostek, ile brakuje kolejce, a gdy nic nie jest wolne, czeka z nimi na
+ * WEZEL_RELEASE. Jednostki rozdziela firmom z poczatku kolejki przez
+ * LICZNIK_WPUSZCZENIE, wiec firmy przechodza stany jak w trybie licznikow.
+ * Jednostki oddane przez firmy lider od razu oddaje innym wezlom, chyba ze
+ * ma wlasnie zgody wszystkich liderow, bo wtedy nikt wazniejszy nie czeka.
+ *
+ * Miedzy wezlami ida tylko wiadomosci liderow, jedna runda zgod na kolejke
+ * wezla, a nie rozgloszenie zadania kazdej firmy do wszystkich firm.
+ *
+*/
 
-    MPI_Status status;
+// Miejsce firmy w oknie lidera, jedno na zasob
+typedef struct {
+    std::atomic<int> chce;   // Jednostki, o ktore firma prosi, lider zeruje je, ustawiajac ja w kolejce
+    std::atomic<int> oddane; // Jednostki oddane przez firme, ktorych lider jeszcze nie zebral
+    std::atomic<int> zegar;  // Zegar Lamporta firmy przy ostatnim oddaniu
+    int zapas[13];           // Kazde miejsce w osobnej linii pamieci podrecznej
+} tmiejsceWezla;
 
-    lamport++;    //Inkrementacja zegara Lamporta przed wyslaniem broadcastu
-    tmessage request;
-    request.pid = id;      // Nasze id, potrzebne do priorytetu
-    request.tim = lamport; // Nasz zegar
-    request.val = lamport; // Tu dodatkowo zapamietujemy zegar Lamporta przy wyslaniu, zeby uniknac sytuacji
+// Zasob rozgrywany przez lidera z liderami innych wezlow
+typedef struct {
+    bool wlaczony;                            // Zasob w trybie Ricarta, przydziela go lider
+    int pojemnosc;                            // K albo L
+    std::deque<std::pair<int, int> > kolejka; // Czekajace firmy wezla: miejsce i ile chce
+    int popyt;                                // Suma jednostek, ktore chce kolejka
+    int trzymane;                             // Jednostki wezla, takze przydzielone firmom
+    int wolne;                                // Jednostki wezla, ktorych nie ma zadna firma
+    std::vector<int> uLidera;                 // Jednostki innych wezlow wg ostatniej wiadomosci ich lidera
+    bool ubiega;
+    int lamportZadania;
+    int zgody;
+    std::vector<int> odlozone;                // Liderzy, ktorym odpowiemy po zajeciu jednostek
+} tzasobWezla;
 
-    for (int i = 0; i < N; i++) {
-        if (i != id) {
-            MPI_Send(&request, 3, MPI_INT, i, OKNO_REQUEST, MPI_COMM_WORLD);
-        }
-    }
+typedef struct {
+    bool wlaczone;
+    MPI_Comm komunikator;     // Procesy wezla, MPI_COMM_NULL u monitora
+    MPI_Win okno;
+    tmiejsceWezla * miejsca;  // Okno lidera, miejsce i zasobu z to miejsca[z * rozmiar + i]
+    int rozmiar;              // Liczba firm wezla
+    int miejsce;              // Nasze miejsce w wezle
+    int lider;                // Id lidera naszego wezla
+    std::vector<int> firmy;   // Id firm wezla wg miejsca
+    std::vector<int> liderzy; // Liderzy innych wezlow
+    tzasobWezla zasob[2];
+} twezly;
+
+twezly wezly;
+
+void wezelWyslij(tfirma &f, int cel, int tag, int z, int jednostki) {
+    tmessage message;
+    message.pid = f.id;
+    message.tim = f.lamport;
+    message.val = 2 * jednostki + z;
+    f.wyslane++;
+    nadaj(f, cel, tag, message);
+}
 
-    int lamporttimeonsend = lamport; // Musimy zapamietac zegar Lamporta przy wysylaniu, aby nie uznac przedawnionej zgody
-                                     // z poprzedniego ubiegania sie o sekcje
+void wezelRozeslij(tfirma &f, int tag, int z, int jednostki) {
+    f.lamport++;
+    for (int i = 0; i < wezly.liderzy.size(); i++)
+        wezelWyslij(f, wezly.liderzy[i], tag, z, jednostki);
+}
 
-    printf("%d %d : Firma <%d> wyslala broadcast OKNO_REQUEST\n", lamport, id, id);
+// Oddaje innym wezlom jednostki, ktorych nie ma zadna firma wezla
+void wezelOddaj(tfirma &f, int z) {
+    tzasobWezla &r = wezly.zasob[z];
+    r.trzymane -= r.wolne;
+    r.wolne = 0;
+    wezelRozeslij(f, WEZEL_RELEASE, z, r.trzymane);
+}
 
-    int agreements = 0;
+void wezelUbiegaj(tfirma &f, int z);
+
+// Ze zgodami wszystkich liderow zajmujemy brakujace jednostki i rozdzielamy je kolejce
+void wezelSekcja(tfirma &f, int z) {
+    tzasobWezla &r = wezly.zasob[z];
+    if (!r.ubiega || r.zgody < wezly.liderzy.size()) return;
+
+    int wolneGdzies = r.pojemnosc - r.trzymane;
+    for (int i = 0; i < wezly.liderzy.size(); i++)
+        wolneGdzies -= r.uLidera[wezly.liderzy[i]];
+    int brakuje = r.popyt - r.wolne;
+    if (brakuje > 0 && wolneGdzies > 0) {
+        int bierze = brakuje < wolneGdzies ? brakuje : wolneGdzies;
+        r.trzymane += bierze;
+        r.wolne += bierze;
+    }
+    if (r.wolne == 0) return; // Czekamy na WEZEL_RELEASE albo oddanie w wezle
+
+    while (!r.kolejka.empty() && r.wolne > 0) {
+        int miejsce = r.kolejka.front().first, chce = r.kolejka.front().second;
+        r.kolejka.pop_front();
+        r.popyt -= chce;
+        int ile = chce < r.wolne ? chce : r.wolne;
+        r.wolne -= ile;
+        wpuscZLicznika(f, z, wezly.firmy[miejsce], ile);
+    }
+    if (r.wolne > 0) wezelOddaj(f, z);
+
+    r.ubiega = false;
+    f.lamport++;
+    for (int i = 0; i < r.odlozone.size(); i++)
+        wezelWyslij(f, r.odlozone[i], WEZEL_AGREE, z, r.trzymane);
+    r.odlozone.clear();
+    if (!r.kolejka.empty()) wezelUbiegaj(f, z); // Reszta kolejki za odlozonymi
+}
 
-    bool * agree = new bool[N];
+void wezelUbiegaj(tfirma &f, int z) {
+    tzasobWezla &r = wezly.zasob[z];
+    r.ubiega = true;
+    r.zgody = 0;
+    f.lamport++;
+    r.lamportZadania = f.lamport;
+    for (int i = 0; i < wezly.liderzy.size(); i++)
+        wezelWyslij(f, wezly.liderzy[i], WEZEL_REQUEST, z, 0);
+    wezelSekcja(f, z); // Jedyny wezel nie czeka na zgody
+}
 
-    for (int i = 0; i < N; i++) agree[i] = false;
+// Wiadomosc od lidera innego wezla
+void obsluzWiadomoscWezla(tfirma &f, int tag, tmessage &message, int source) {
+    f.lamport = (message.tim > f.lamport ? message.tim : f.lamport) + 1;
+    int z = message.val & 1, jednostki = message.val >> 1;
+    tzasobWezla &r = wezly.zasob[z];
+    if (tag == WEZEL_REQUEST) {
+        if (r.ubiega && (r.lamportZadania < message.tim || (r.lamportZadania == message.tim && f.id < message.pid)))
+            r.odlozone.push_back(source);
+        else
+            wezelWyslij(f, source, WEZEL_AGREE, z, r.trzymane);
+        return;
+    }
+    r.uLidera[source] = jednostki;
+    if (tag == WEZEL_AGREE && r.ubiega) r.zgody++;
+    wezelSekcja(f, z);
+}
 
-    do {
-        tmessage recvmessage;
-        tmessage message;
-        MPI_Recv(&recvmessage, 3, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        switch (status.MPI_TAG) {
-        case KLINIKA_REQUEST:  // nie ubiegamy sie o sekcje, wiec od razu wysylamy AGREE
-            printf("%d %d : Firma <%d> oczekuje na okienko, otrzymala wiadomosc KLINIKA_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            lamport++;
-            message.pid = id;
-            message.tim = lamport;
-            message.val = 0;
-            MPI_Send(&message, 3, MPI_INT, status.MPI_SOURCE, KLINIKA_AGREE, MPI_COMM_WORLD);
-            printf("%d %d : Firma <%d> oczekuje na okienko, wysyla wiadomosc KLINIKA_AGREE do %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            klinikainside.push_back(recvmessage);
-            break;
-        case OKNO_REQUEST:   // ubiegamy sie o sekcje, AGREE zalezy od priorytetu
-            printf("%d %d : Firma <%d> oczekuje na okienko, otrzymala wiadomosc OKNO_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            if ((lamporttimeonsend < recvmessage.tim) || ((lamporttimeonsend == recvmessage.tim) && (id < recvmessage.pid))) {
-                // Mam pierwszenstwo do okna
-                okienkawaiting.push_back(recvmessage);
-                printf("%d %d : Firma <%d> oczekuje na okienko, otrzymuje pierwszenstwo przed %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-                if (!agree[recvmessage.pid]) {
-                    agreements++;
-                    agree[recvmessage.pid] = true;
-                    printf("%d %d : Firma <%d> ma juz %d OKNO_AGREE\n", lamport, id, id, agreements);
-                }
-            }
-            else {
-                printf("%d %d : Firma <%d> oczekuje na okienko, nie ma pierwszenstwa przed %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            }
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            break;
-        case OKNO_AGREE:   // gdy otrzymujemy zgode, to inkrementujemy licznik zgod
-            printf("%d %d : Firma <%d> oczekuje na okienko, otrzymala wiadomosc OKNO_AGREE %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            if (recvmessage.val == lamporttimeonsend)
-                if (!agree[recvmessage.pid]) {
-                    agreements++;
-                    agree[recvmessage.pid] = true;
-                    printf("%d %d : Firma <%d> ma juz %d OKNO_AGREE\n", lamport, id, id, agreements);
-                }
-            break;
-        case KLINIKA_AGREE:   // musimy czyscic nasza liste zapamietanych procesow w klinice, aby uniknac bledow
-            printf("%d %d : Firma <%d> otrzymala wiadomosc KLINIKA_AGREE zwalniajaca miejsce %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            if (recvmessage.val > 0) { //Jezeli ktos zwalnia miejsce w klinice i wysyla nam zgode, to musimy go usunac z naszej listy obecnych w klinice
-                int i = 0;
-                if (!klinikainside.empty()) {
-                    while (i < klinikainside.size() && klinikainside.at(i).pid != recvmessage.pid) i++;
-                    if (i < klinikainside.size()) klinikainside.erase(klinikainside.begin()+i);
-                }
+// Lider zbiera zgloszenia firm wezla, zwraca czy ktoras cos zglosila
+bool obsluzWezel(tfirma &f) {
+    bool zmiana = false;
+    for (int z = 0; z < 2; z++) {
+        tzasobWezla &r = wezly.zasob[z];
+        if (!r.wlaczony) continue;
+        int oddane = 0;
+        bool nowe = false;
+        for (int i = 0; i < wezly.rozmiar; i++) {
+            tmiejsceWezla &m = wezly.miejsca[z * wezly.rozmiar + i];
+            if (m.oddane.load(std::memory_order_relaxed) != 0) {
+                oddane += m.oddane.exchange(0, std::memory_order_acquire);
+                int zegar = m.zegar.load(std::memory_order_relaxed);
+                if (zegar >= f.lamport) f.lamport = zegar + 1; // Monitor: zajecie po zwolnieniu, z ktorego pochodzi
             }
-            break;
-        default:
-            if (status.MPI_TAG != INSIDE) {
-                lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-                lamport++;
+            if (m.chce.load(std::memory_order_relaxed) != 0) {
+                int chce = m.chce.exchange(0, std::memory_order_acquire);
+                r.kolejka.push_back(std::make_pair(i, chce));
+                r.popyt += chce;
+                nowe = true;
             }
         }
-    } while (agreements < N - L);
-
-    printf("%d %d : Firma <%d> otrzymala dostep do okienka\n", lamport, id, id);
+        if (oddane == 0 && !nowe) continue;
+        zmiana = true;
+        r.wolne += oddane;
+        if (r.ubiega && r.zgody == wezly.liderzy.size())
+            wezelSekcja(f, z);
+        else {
+            if (r.wolne > 0) wezelOddaj(f, z);
+            if (!r.ubiega && !r.kolejka.empty()) wezelUbiegaj(f, z);
+        }
+    }
+    return zmiana;
+}
 
-    delete [] agree;
+int zajmijLicznik(tfirma &f, int z, int ile) {
+    if (!wezly.zasob[z].wlaczony) return zajmijLicznikRma(f, z, ile);
+    wezly.miejsca[z * wezly.rozmiar + wezly.miejsce].chce.store(ile, std::memory_order_release);
+    return 0; // Wpusci nas lider
 }
 
-// STAN 4-----------------------------------------------------------------------
+void zwolnijLicznik(tfirma &f, int z, int ile) {
+    if (!wezly.zasob[z].wlaczony) {
+        zwolnijLicznikRma(f, z, ile);
+        return;
+    }
+    tmiejsceWezla &m = wezly.miejsca[z * wezly.rozmiar + wezly.miejsce];
+    m.zegar.store(f.lamport, std::memory_order_relaxed);
+    m.oddane.fetch_add(ile, std::memory_order_release);
+}
 
-// Kod watku sterujacego w stanie 4
-void state4Control() {
-    // Firma realizuje papierkologie
-    sleep(rand() % max_wait_o);
+// Dzieli procesy na wezly i tworzy okno lidera, wywoluja je wszystkie procesy, takze monitor
+void otworzWezly(tfirma &f, int naWezel) {
+    bool firma = f.id != f.monitor;
+    if (naWezel == 1)
+        MPI_Comm_split_type(MPI_COMM_WORLD, firma ? MPI_COMM_TYPE_SHARED : MPI_UNDEFINED, f.id, MPI_INFO_NULL, &wezly.komunikator);
+    else
+        MPI_Comm_split(MPI_COMM_WORLD, firma ? f.id / naWezel : MPI_UNDEFINED, f.id, &wezly.komunikator);
+    wezly.wlaczone = firma;
+    wezly.lider = f.id;
+    if (firma) {
+        MPI_Comm_rank(wezly.komunikator, &wezly.miejsce);
+        MPI_Comm_size(wezly.komunikator, &wezly.rozmiar);
+        MPI_Bcast(&wezly.lider, 1, MPI_INT, 0, wezly.komunikator);
+    }
+    int procesy;
+    MPI_Comm_size(MPI_COMM_WORLD, &procesy);
+    silnik.liderFirmy.resize(procesy);
+    silnik.pozaWezlem = 0;
+    MPI_Allgather(&wezly.lider, 1, MPI_INT, silnik.liderFirmy.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    if (!firma) return;
+
+    wezly.firmy.resize(wezly.rozmiar);
+    MPI_Allgather(&f.id, 1, MPI_INT, wezly.firmy.data(), 1, MPI_INT, wezly.komunikator);
+    for (int i = 0; i < f.N; i++)
+        if (silnik.liderFirmy[i] == i && i != f.id)
+            wezly.liderzy.push_back(i);
+
+    MPI_Aint rozmiar = wezly.miejsce == 0 ? 2 * wezly.rozmiar * sizeof(tmiejsceWezla) : 0;
+    void * baza;
+    MPI_Win_allocate_shared(rozmiar, sizeof(tmiejsceWezla), MPI_INFO_NULL, wezly.komunikator, &baza, &wezly.okno);
+    int jednostka;
+    MPI_Win_shared_query(wezly.okno, 0, &rozmiar, &jednostka, &baza);
+    wezly.miejsca = (tmiejsceWezla *) baza;
+    if (wezly.miejsce == 0) memset(baza, 0, rozmiar);
+    MPI_Barrier(wezly.komunikator); // Okno jest wyzerowane, zanim ktokolwiek cos w nim zglosi
+
+    for (int z = 0; z < 2; z++) {
+        tzasobWezla &r = wezly.zasob[z];
+        r.wlaczony = z == ZASOB_KLINIKA ? f.trybKliniki == KLINIKA_RICART : f.trybOkna == OKNO_RICART;
+        r.pojemnosc = z == ZASOB_KLINIKA ? f.K : f.L;
+        r.popyt = 0;
+        r.trzymane = 0;
+        r.wolne = 0;
+        r.uLidera.assign(f.N, 0);
+        r.ubiega = false;
+        r.zgody = 0;
+    }
+}
 
-    tmessage message;
-    message.pid = id;     // ID procesu, wysylamy sami do siebie
-    message.tim = -1;     // Tu normalnie zegar Lamporta, lecz wiadomosci INSIDE
-                          // korzystaja z zegaru Lamporta
-    message.val = 0;      // Nie mamy konkretnej wartosci do podeslania
-    MPI_Send(&message, 3, MPI_INT, id, INSIDE, MPI_COMM_WORLD);
+void zamknijWezly() {
+    if (!wezly.wlaczone) return;
+    MPI_Win_free(&wezly.okno);
+    MPI_Comm_free(&wezly.komunikator);
 }
 
-void state4Communication() {
-    MPI_Status status;
+// BENCHMARK--------------------------------------------------------------------
 
-    tmessage recvmessage;
-
-    do {
-        tmessage message;
-        MPI_Recv(&recvmessage, 3, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        switch (status.MPI_TAG) {
-        case KLINIKA_REQUEST:
-            printf("%d %d : Firma <%d> jest przy oknie, otrzymala wiadomosc KLINIKA_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            lamport++;
-            message.pid = id;
-            message.tim = lamport;
-            message.val = 0;
-            MPI_Send(&message, 3, MPI_INT, status.MPI_SOURCE, KLINIKA_AGREE, MPI_COMM_WORLD);
-            printf("%d %d : Firma <%d> jest przy oknie, wysyla wiadomosc KLINIKA_AGREE do %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            klinikainside.push_back(recvmessage);
-            break;
-        case OKNO_REQUEST:
-            printf("%d %d : Firma <%d> jest przy oknie, otrzymala wiadomosc OKNO_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            // jestem przy oknie
-            okienkawaiting.push_back(recvmessage);
-            printf("%d %d : Firma <%d> jest przy oknie, kolejkuje zadanie %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            break;
-        case KLINIKA_AGREE:   // musimy czyscic nasza liste zapamietanych procesow w klinice, aby uniknac bledow
-            printf("%d %d : Firma <%d> otrzymala wiadomosc KLINIKA_AGREE zwalniajaca miejsce %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            if (recvmessage.val > 0) { //Jezeli ktos zwalnia miejsce w klinice i wysyla nam zgode, to musimy go usunac z naszej listy obecnych w klinice
-                if (!klinikainside.empty()) {
-                    int i = 0;
-                    while (i < klinikainside.size() && klinikainside.at(i).pid != recvmessage.pid) i++;
-                    if (i < klinikainside.size()) klinikainside.erase(klinikainside.begin()+i);
-                }
-            }
-            break;
-        default:
-            if (status.MPI_TAG != INSIDE) {
-                lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-                lamport++;
-            }
-        }
-    } while (status.MPI_TAG != INSIDE);
-    printf("%d %d : Firma <%d> skonczyla papierkologie\n", lamport, id, id);
-}
+/*
+ * Firma w STAN_KONIEC dolacza do nieblokujacej bariery. Bariera konczy sie,
+ * gdy wszystkie firmy skoncza rundy, a wtedy nikt nie czeka juz na nasze
+ * odpowiedzi i silnik moze sie zatrzymac.
+ *
+*/
 
-// STAN 5-----------------------------------------------------------------------
+void zakonczPrace(tfirma &f) {
+    MPI_Ibarrier(MPI_COMM_WORLD, &silnik.bariera);
+    silnik.konczy = true;
+}
 
-void state5Communication() {
-    lamport++;
-    tmessage leave;
-    leave.pid = id;      // Nasze id, potrzebne do priorytetu
-    leave.tim = lamport; // Nasz zegar
-    leave.val = 0;       // To trzeba dostosowywac do zegaru Lamporta, z jakim byla wysylana nam ta wiadomosc
+// Wspolny start wszystkich procesow, od niego liczymy czas trwania benchmarku
+void startBenchmarku(tfirma &f, int sekundy) {
+    if (f.benchmark) MPI_Barrier(MPI_COMM_WORLD);
+    f.czasStartu = MPI_Wtime();
+    f.czasKonca = sekundy > 0 ? f.czasStartu + sekundy : 0;
+}
 
-    for (int i = 0; i < okienkawaiting.size(); i++) {
-        leave.val = okienkawaiting.at(i).val;
-        MPI_Send(&leave, 3, MPI_INT, okienkawaiting.at(i).pid, OKNO_AGREE, MPI_COMM_WORLD);
-        printf("%d %d : Firma <%d> opuszcza okienko, wysyla zgode do skolejkowanego %d %d\n", lamport, id, id, okienkawaiting.at(i).tim, okienkawaiting.at(i).pid);
+// Zbiera wyniki wszystkich procesow w procesie 0, wywoluja ja wszystkie procesy
+void raportBenchmarku(tfirma &f) {
+    long long lokalne[4] = {f.wyslane, silnik.transfery, rma.operacje, silnik.pozaWezlem};
+    long long suma[4];     // Wiadomosci, paczki, operacje na licznikach rma i wiadomosci poza wezel
+    std::vector<long long> opoznienia[2];
+    double czas;
+    for (int z = 0; z < 2; z++) {
+        opoznienia[z].assign(KUBELKI_OPOZNIEN, 0);
+        MPI_Reduce(f.opoznienia[z].data(), opoznienia[z].data(), KUBELKI_OPOZNIEN, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
     }
-    okienkawaiting.clear();
-    printf("%d %d : Firma <%d> rozeslala zgody do skolejkowanych firm\n", lamport, id, id);
+    MPI_Reduce(lokalne, suma, 4, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&f.czasPracy, &czas, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (f.id != 0) return;
+
+    printf("\nBenchmark: N = %d, K = %d, L = %d, rund %d, czas %.3f s\n", f.N, f.K, f.L, f.rundy, czas);
+    wypiszWyniki(f, czas, opoznienia, suma[0], suma[1]);
+    long long dostepy = 0;
+    for (int z = 0; z < 2; z++)
+        for (int k = 0; k < KUBELKI_OPOZNIEN; k++)
+            dostepy += opoznienia[z][k];
+    if (f.trybKliniki == KLINIKA_RMA || f.trybOkna == OKNO_RMA)
+        printf("operacje atomowe rma: %lld, %.1f na dostep\n", suma[2], dostepy > 0 ? (double) suma[2] / dostepy : 0.0);
+    if (!silnik.liderFirmy.empty())
+        printf("wiadomosci do innych wezlow: %lld, %.1f na dostep\n", suma[3], dostepy > 0 ? (double) suma[3] / dostepy : 0.0);
+    fflush(stdout);
 }
 
-// Odczekanie na wyslanie dodatkowych wiadomosci--------------------------------
+// SILNIK PROTOKOLU-------------------------------------------------------------
 
-void waitControll() {
-    // Funkcja tymczasowa, na potrzeby debugowania
-    sleep(120);
+// Obsluguje po kolei wiadomosci z odebranej paczki
+void obsluzPaczke(tfirma &f, tpakiet * pakiety, int ile, int source) {
+    for (int i = 0; i < ile; i++) {
+        if (pakiety[i].wersja != WERSJA_PAKIETU) {
+            DZIENNIK_DOSTEP(f, ZD_ZLY_PAKIET, pakiety[i].tag, source, pakiety[i].wersja, source);
+            continue;
+        }
+        tmessage recvmessage;
+        recvmessage.pid = pakiety[i].pid;
+        recvmessage.tim = pakiety[i].tim;
+        recvmessage.val = pakiety[i].val;
+        if (pakiety[i].tag >= WEZEL_REQUEST && pakiety[i].tag <= WEZEL_RELEASE) { // Do lidera, nie do firmy
+            f.liczniki->obsluzone[f.stan][pakiety[i].tag]++;
+            obsluzWiadomoscWezla(f, pakiety[i].tag, recvmessage, source);
+            obsluzZdarzenieSilnika(f);
+            continue;
+        }
+        nagraj(NAGRANIE_WIADOMOSC, pakiety[i].tag, source, recvmessage);
+        obsluzWiadomosc(f, pakiety[i].tag, recvmessage, source);
+    }
+}
 
-    tmessage message;
-    message.pid = id;     // ID procesu, wysylamy sami do siebie
-    message.tim = -1;     // Tu normalnie zegar Lamporta, lecz wiadomosci INSIDE
-                          // korzystaja z zegaru Lamporta
-    message.val = 0;      // Nie mamy konkretnej wartosci do podeslania
-    MPI_Send(&message, 3, MPI_INT, id, INSIDE, MPI_COMM_WORLD);
-}
-
-void waitCommunication() {
-    /*
-     * To tymczasowa funkcja na potrzeby debugowania, czeka by
-     * odpowiedziec reszcie firm, ktore jeszcze pracuja
-     */
+void silnikProtokolu(tfirma &f) {
     MPI_Status status;
+    MPI_Request odbior;
+    tpakiet odebrane[MAX_PACZKA];
+    int gotowe, ile;
+    int bezczynne = 0; // Liczba kolejnych obiegow bez zadnego zdarzenia
+    tmessage pusta = {f.id, -1, 0}; // Tresc zdarzen bez wiadomosci w nagraniu
 
-    tmessage recvmessage;
-
-    do {
-        tmessage message;
-        MPI_Recv(&recvmessage, 3, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        switch (status.MPI_TAG) {
-        case KLINIKA_REQUEST:  // nie ubiegamy sie o sekcje, wiec od razu wysylamy AGREE
-            printf("%d %d : Firma <%d> skonczyla prace, otrzymala wiadomosc KLINIKA_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            lamport++;
-            message.pid = id;
-            message.tim = lamport;
-            message.val = 0;
-            MPI_Send(&message, 3, MPI_INT, status.MPI_SOURCE, KLINIKA_AGREE, MPI_COMM_WORLD);
-            printf("%d %d : Firma <%d> skonczyla prace, wysyla wiadomosc KLINIKA_AGREE do %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            klinikainside.push_back(recvmessage);
-            break;
-        case OKNO_REQUEST:     // nie ubiegamy sie o sekcje, wiec od razu wysylamy AGREE
-            printf("%d %d : Firma <%d> skonczyla prace, otrzymala wiadomosc OKNO_REQUEST %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            lamport++;
-            message.pid = id;
-            message.tim = lamport;
-            message.val = recvmessage.val;
-            MPI_Send(&message, 3, MPI_INT, status.MPI_SOURCE, OKNO_AGREE, MPI_COMM_WORLD);
-            printf("%d %d : Firma <%d> skonczyla prace, wysyla wiadomosc OKNO_AGREE do %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            break;
-        case KLINIKA_AGREE:   // musimy czyscic nasza liste zapamietanych procesow w klinice, aby uniknac bledow
-            printf("%d %d : Firma <%d> otrzymala wiadomosc KLINIKA_AGREE zwalniajaca miejsce %d %d\n", lamport, id, id, recvmessage.tim, recvmessage.pid);
-            lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-            lamport++;
-            if (recvmessage.val > 0) { //Jezeli ktos zwalnia miejsce w klinice i wysyla nam zgode, to musimy go usunac z naszej listy obecnych w klinice
-                int i = 0;
-                if (!klinikainside.empty()) {
-                    while (i < klinikainside.size() && klinikainside.at(i).pid != recvmessage.pid) i++;
-                    if (i < klinikainside.size()) klinikainside.erase(klinikainside.begin()+i);
-                }
-            }
-            break;
-        default:
-            if (status.MPI_TAG != INSIDE) {
-                lamport = lamport > recvmessage.tim ? lamport : recvmessage.tim;
-                lamport++;
-            }
+    nagraj(NAGRANIE_START, INSIDE, f.id, pusta);
+    uruchomFirme(f);
+
+    MPI_Irecv(odebrane, MAX_PACZKA, typPakietu, MPI_ANY_SOURCE, TAG_PACZKA, MPI_COMM_WORLD, &odbior);
+
+    while (1) {
+        if (!silnik.celePaczek.empty()) {
+            double poczatek = MPI_Wtime();
+            wyslijPaczki(f);
+            f.liczniki->czasWysylania += MPI_Wtime() - poczatek;
         }
-    } while (status.MPI_TAG != INSIDE);
-}
+        if (!silnik.paczki.empty()) postepRozsylania(f);
 
-// MAIN-------------------------------------------------------------------------
+        if (silnik.konczy) {
+            MPI_Test(&silnik.bariera, &gotowe, MPI_STATUS_IGNORE);
+            if (gotowe) break;
+        }
+        else if (zatrzymanie && !f.zatrzymana) {
+            nagraj(NAGRANIE_ZATRZYMANIE, KONIEC_PRACY, f.id, pusta);
+            zatrzymajFirme(f);
+            bezczynne = 0;
+        }
 
-int main(int argc, char * argv[]) {
+        if (wezly.wlaczone && wezly.lider == f.id && obsluzWezel(f)) {
+            obsluzZdarzenieSilnika(f);
+            bezczynne = 0;
+        }
 
-    // Inicjalizacja srodowiska MPI
-    int provided;
-    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
-    MPI_Comm_size(MPI_COMM_WORLD, &N);
-    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+        if (silnik.kanal->pobudka.load(std::memory_order_acquire)) {
+            silnik.kanal->pobudka.store(false, std::memory_order_relaxed);
+            nagraj(NAGRANIE_POBUDKA, INSIDE, f.id, pusta);
+            obsluzPobudke(f);
+            bezczynne = 0;
+        }
 
-    srand(time(NULL)+id);
+        MPI_Test(&odbior, &gotowe, &status);
+        if (gotowe) {
+            MPI_Get_count(&status, typPakietu, &ile);
+            obsluzPaczke(f, odebrane, ile, status.MPI_SOURCE);
+            MPI_Irecv(odebrane, MAX_PACZKA, typPakietu, MPI_ANY_SOURCE, TAG_PACZKA, MPI_COMM_WORLD, &odbior);
+            bezczynne = 0;
+            continue;
+        }
 
-    if (argc < 3) {
-        printf("\nNie uruchomiono prawidlowo programu.\n"
-               "Prawidlowe uruchomienie to:\nmpirun -np <N> %s <K> <L>\n"
-               "Gdzie N- liczba firm, "
-               "K- miejsca w klinice, L- liczba okien\n", argv[0]);
-        MPI_Finalize();
-        return -1;
+        // Gdy dlugo nic sie nie dzieje, to przestajemy zajmowac rdzen
+        bezczynne++;
+        if (bezczynne > prog_aktywny) {
+            double poczatek = MPI_Wtime();
+            if (bezczynne > prog_uspienia)
+                usleep(100);
+            else
+                sched_yield();
+            f.liczniki->czasBezczynny += MPI_Wtime() - poczatek;
+        }
     }
 
-    K = atoi(argv[1]); // Zadeklarowanie miejsc w klinice
-    L = atoi(argv[2]); // Zadeklarowanie okienek w urzedzie
+    // Wszystkie firmy skonczyly prace, konczymy wlasne wysylki i odbior
+    while (!silnik.paczki.empty()) postepRozsylania(f);
+    MPI_Cancel(&odbior);
+    MPI_Wait(&odbior, MPI_STATUS_IGNORE);
+}
 
-    while (1) {
+// MONITOR----------------------------------------------------------------------
 
-        // STAN 1 oczekiwanie na idiotow
+/*
+ * W trybie monitora ostatni proces nie jest firma, tylko w trakcie pracy
+ * sprawdza, czy w klinice jest co najwyzej K idiotow, a przy okienkach
+ * co najwyzej L firm. Firmy zglaszaja mu kazda zmiane liczby zajmowanych
+ * jednostek razem z zegarem Lamporta. Zgloszenia roznych firm przychodza
+ * w dowolnej kolejnosci, wiec monitor rozpatruje je w kolejnosci zegarow,
+ * zgodnej z przyczynowoscia, i dopiero wtedy, gdy kazda firma podala juz
+ * wiekszy zegar, czyli nie zglosi niczego wczesniejszego. Aby bezczynne
+ * firmy nie wstrzymywaly sprawdzania, monitor co takt wysyla wszystkim
+ * MONITOR_ZEGAR z najwiekszym znanym zegarem, a firmy odpowiadaja swoim.
+ *
+*/
 
-        #pragma omp parallel sections num_threads(2)
-        {
-            #pragma omp section
-            {
-                state1Control();
-            }
-            #pragma omp section
-            {
-                state1Communication();
-            }
-        }
+const double takt_monitora  = 0.05; // sekundy miedzy taktami
+const double raport_monitora = 10;  // sekundy miedzy podsumowaniami
 
-        // STAN 2 klinika
+typedef struct {
+    int tim;
+    int pid;
+    int zasob;
+    int miejsca;
+    long long kolejnosc; // Kolejnosc odebrania, rozstrzyga rowne zegary
+} tzgloszenie;
+
+struct tpozniejszeZgloszenie {
+    bool operator()(const tzgloszenie &a, const tzgloszenie &b) const {
+        return a.tim > b.tim || (a.tim == b.tim && a.kolejnosc > b.kolejnosc);
+    }
+};
+
+void silnikMonitora(tfirma &f) {
+    std::priority_queue<tzgloszenie, std::vector<tzgloszenie>, tpozniejszeZgloszenie> czekajace;
+    std::vector<int> zegar(f.N, 0);          // Najwiekszy zegar podany przez firme
+    std::vector<int> miejsca[2];             // Jednostki zajmowane przez firme
+    miejsca[ZASOB_KLINIKA].assign(f.N, 0);
+    miejsca[ZASOB_OKNO].assign(f.N, 0);
+    int zajete[2] = {0, 0}, najwiecej[2] = {0, 0}, limit[2] = {f.K, f.L};
+    const char * nazwa[2] = {"klinika", "okienka"};
+    long long kolejnosc = 0, sprawdzone = 0, naruszenia = 0;
+    int maksZegar = 0;
 
-        do {
-            // STAN 2a ubieganie sie o kklinika
+    MPI_Status status;
+    MPI_Request odbior;
+    tpakiet odebrane[MAX_PACZKA];
+    int gotowe, ile;
+    double takt = MPI_Wtime(), raport = takt;
 
-            state2aCommunication();
+    printf("Monitor <%d> sprawdza %d firm, K = %d, L = %d\n", f.id, f.N, f.K, f.L);
+    MPI_Irecv(odebrane, MAX_PACZKA, typPakietu, MPI_ANY_SOURCE, TAG_PACZKA, MPI_COMM_WORLD, &odbior);
+    MPI_Ibarrier(MPI_COMM_WORLD, &silnik.bariera); // Monitor konczy razem z firmami
+    bool zatrzymal = false;
 
-            // STAN 2b przebywanie w klinice
+    while (1) {
+        MPI_Test(&silnik.bariera, &gotowe, MPI_STATUS_IGNORE);
+        if (gotowe) break;
+
+        if (zatrzymanie && !zatrzymal) { // Sygnal dostal tylko monitor, przekazujemy go firmom
+            tpakiet pakiet;
+            pakiet.wersja = WERSJA_PAKIETU;
+            pakiet.tag = KONIEC_PRACY;
+            pakiet.pid = f.id;
+            pakiet.tim = maksZegar;
+            pakiet.val = 0;
+            for (int i = 0; i < f.N; i++)
+                MPI_Send(&pakiet, 1, typPakietu, i, TAG_PACZKA, MPI_COMM_WORLD);
+            zatrzymal = true;
+        }
 
-            #pragma omp parallel sections
-            {
-                #pragma omp section
-                {
-                    state2bControl();
-                }
-                #pragma omp section
-                {
-                    state2bCommunication();
+        MPI_Test(&odbior, &gotowe, &status);
+        if (gotowe) {
+            MPI_Get_count(&status, typPakietu, &ile);
+            for (int i = 0; i < ile; i++) {
+                tpakiet &p = odebrane[i];
+                if (p.wersja != WERSJA_PAKIETU || p.pid >= f.N) continue;
+                if (p.tim > zegar[p.pid]) zegar[p.pid] = p.tim;
+                if (p.tim > maksZegar) maksZegar = p.tim;
+                if (p.tag == MONITOR_KLINIKA || p.tag == MONITOR_OKNO) {
+                    tzgloszenie z = {p.tim, p.pid, p.tag == MONITOR_KLINIKA ? ZASOB_KLINIKA : ZASOB_OKNO, p.val, kolejnosc++};
+                    czekajace.push(z);
                 }
             }
+            MPI_Irecv(odebrane, MAX_PACZKA, typPakietu, MPI_ANY_SOURCE, TAG_PACZKA, MPI_COMM_WORLD, &odbior);
+        }
+
+        // Zgloszenia starsze niz zegar kazdej firmy sa juz kompletne
+        int prog = zegar[0];
+        for (int i = 1; i < f.N; i++)
+            if (zegar[i] < prog) prog = zegar[i];
+        while (!czekajace.empty() && czekajace.top().tim < prog) {
+            tzgloszenie z = czekajace.top();
+            czekajace.pop();
+            sprawdzone++;
+            zajete[z.zasob] += z.miejsca - miejsca[z.zasob][z.pid];
+            miejsca[z.zasob][z.pid] = z.miejsca;
+            if (zajete[z.zasob] > najwiecej[z.zasob]) najwiecej[z.zasob] = zajete[z.zasob];
+            if (zajete[z.zasob] > limit[z.zasob]) {
+                naruszenia++;
+                printf("%d %d : Monitor <%d> NARUSZENIE: %s ma %d zajetych z %d po zgloszeniu firmy <%d>, zajmuja:",
+                       z.tim, f.id, f.id, nazwa[z.zasob], zajete[z.zasob], limit[z.zasob], z.pid);
+                for (int i = 0; i < f.N; i++)
+                    if (miejsca[z.zasob][i] > 0) printf(" <%d> %d", i, miejsca[z.zasob][i]);
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+
+        double teraz = MPI_Wtime();
+        if (teraz - takt >= takt_monitora) {
+            tpakiet pakiet;
+            pakiet.wersja = WERSJA_PAKIETU;
+            pakiet.tag = MONITOR_ZEGAR;
+            pakiet.pid = f.id;
+            pakiet.tim = maksZegar;
+            pakiet.val = 0;
+            for (int i = 0; i < f.N; i++)
+                MPI_Send(&pakiet, 1, typPakietu, i, TAG_PACZKA, MPI_COMM_WORLD);
+            takt = teraz;
+        }
+        if (teraz - raport >= raport_monitora) {
+            printf("Monitor <%d> sprawdzil %lld zgloszen, naruszen %lld, najwiecej zajetych: klinika %d z %d, okienka %d z %d\n",
+                   f.id, sprawdzone, naruszenia, najwiecej[ZASOB_KLINIKA], f.K, najwiecej[ZASOB_OKNO], f.L);
+            fflush(stdout);
+            raport = teraz;
+        }
+        if (!gotowe) usleep(100);
+    }
 
-            // STAN 2c zwolnienie miejsc w klinice
+    printf("Monitor <%d> sprawdzil %lld zgloszen, naruszen %lld, najwiecej zajetych: klinika %d z %d, okienka %d z %d\n",
+           f.id, sprawdzone, naruszenia, najwiecej[ZASOB_KLINIKA], f.K, najwiecej[ZASOB_OKNO], f.L);
+    MPI_Cancel(&odbior);
+    MPI_Wait(&odbior, MPI_STATUS_IGNORE);
+}
 
-            state2cCommunication();
+// MAIN-------------------------------------------------------------------------
 
-        } while (idiots > 0);
+int main(int argc, char * argv[]) {
 
-        // STAN 3 ubieganie sie o okno
+    // Inicjalizacja srodowiska MPI
+    tfirma f;
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    ustawSygnaly();
+    MPI_Comm_size(MPI_COMM_WORLD, &f.N);
+    MPI_Comm_rank(MPI_COMM_WORLD, &f.id);
 
-        state3Communication();
+    zbudujTypPakietu();
 
-        // STAN 4 przebywanie przy okienku
+    topcje o;
+    domyslneOpcje(o);
+    o.cicho = f.id != 0; // Bledy wypisuje tylko proces 0
 
-        #pragma omp parallel sections num_threads(2)
-        {
-            #pragma omp section
-            {
-                state4Control();
-            }
-            #pragma omp section
-            {
-                state4Communication();
-            }
-        }
+    int opcja;
+    bool dobrze = true;
+    while ((opcja = getopt(argc, argv, "c:bwqtamH:d:v:n:r:s:z:I:C:O:X:")) != -1)
+        if (!opcjaKrotka(o, opcja, optarg)) dobrze = false;
 
-        // STAN 5 zwolnienie okienek
+    if (argc - optind == 2) { // K i L mozna tez podac w konfiguracji
+        dobrze = ustawOpcje(o, "miejsca", argv[optind]) && dobrze;
+        dobrze = ustawOpcje(o, "okienka", argv[optind + 1]) && dobrze;
+    }
+    else if (argc - optind != 0)
+        dobrze = false;
+
+    if (!dobrze || (o.monitor && f.N < 2) || !sprawdzOpcje(o, o.monitor ? f.N - 1 : f.N)) {
+        if (f.id == 0)
+            printf("\nNie uruchomiono prawidlowo programu.\n"
+                   "Prawidlowe uruchomienie to:\nmpirun -np <N> %s [-c plik] [-b] [-w | -q | -a] [-t] [-m] [-H n] [-d prefiks] [-v poziom] [-n prefiks]\n"
+                   "    [-r rundy | -s sekundy] [-z ziarno] [-I ms] [-C ms] [-O ms] [-X idioci] <K> <L>\n"
+                   "Gdzie N- liczba firm, "
+                   "K- miejsca w klinice, L- liczba okien\n"
+                   "-c- plik konfiguracji z wierszami klucz = wartosc (opis w opcje.h), K i L moga byc w nim zamiast w argumentach\n"
+                   "-b- wysylanie paczek blokujacymi MPI_Send zamiast MPI_Isend\n"
+                   "-w- klinika jako semafor wazony, firma zajmuje w jednej rundzie wszystkie wolne miejsca\n"
+                   "-q- klinika i okienka ze zgodami kworum (rzad i kolumna w siatce firm) zamiast wszystkich firm\n"
+                   "-t- okienka z L krazacymi zetonami, prosba o zeton trafia tylko do firmy 0\n"
+                   "-a- klinika i okienka jako liczniki w oknach RMA firm 0 i 1, zajecie bez kolejki to jedna operacja atomowa\n"
+                   "-m- ostatni proces jest monitorem sprawdzajacym w trakcie pracy, czy zajetych jest najwyzej K i L\n"
+                   "-H- klinika i okienka w trybie Ricarta przez liderow wezlow, 1- wezel to procesy ze wspolna pamiecia,\n"
+                   "    n- po n kolejnych procesow na wezel, ktore musza byc na jednym komputerze\n"
+                   "-d- dziennik firmy i w pliku <prefiks>.i.bin (domyslnie dziennik), tekst daje ./dekoder.out\n"
+                   "-v- poziom dziennika: 0 bez zapisow, 1 dostepy, 2 takze wiadomosci (domyslnie %d)\n"
+                   "-n- nagranie zdarzen firmy i w pliku <prefiks>.i.bin do powtorki przez ./powtorka.out\n"
+                   "-r, -s- benchmark: kazda firma wykonuje tyle rund albo pracuje tyle sekund, na koniec raport\n"
+                   "    bez nich firmy pracuja do sygnalu SIGINT, SIGTERM lub SIGUSR1 (kill -USR1 <pid mpirun>)\n"
+                   "-z- ziarno losowania, firma i losuje z ziarnem z + i (domyslnie z zegara)\n"
+                   "-I, -C, -O- maksymalny czas w ms oczekiwania na idiotow, pobytu w klinice i papierkologii (domyslnie %d, %d, %d)\n"
+                   "-X- idiotow przychodzi od 1 do X - 1 (domyslnie %d)\n",
+                   argv[0], DZIENNIK_POZIOM, max_wait_i, max_wait_k, max_wait_o, max_idiots);
+        MPI_Type_free(&typPakietu);
+        MPI_Finalize();
+        return -1;
+    }
 
-        state5Communication();
+    ustawFirme(f, o);
+    srand(o.ziarno + f.id);
+    const char * prefiksDziennika = o.dziennik;
+    int sekundy = o.sekundy;
+    bool zMonitorem = o.monitor;
 
+    f.benchmark = f.maxRund > 0 || sekundy > 0;
+    inicjujBenchmark(f);
+
+    f.monitor = -1;
+    if (zMonitorem) { // Monitor nie jest firma, firm jest o jedna mniej
+        f.N--;
+        f.monitor = f.N;
+    }
+    bool licznikiRma = f.trybKliniki == KLINIKA_RMA || f.trybOkna == OKNO_RMA;
+    if (licznikiRma) otworzLicznikiRma(f);
+    if (o.wezly > 0) otworzWezly(f, o.wezly);
+    if (f.id == f.monitor) {
+        startBenchmarku(f, sekundy);
+        silnikMonitora(f);
+        if (licznikiRma) zamknijLicznikiRma();
+        if (f.benchmark) raportBenchmarku(f);
+        MPI_Type_free(&typPakietu);
+        MPI_Finalize();
+        return 0;
     }
-    /*
-    // ODCZEKANIE NA INNE PROCESY
 
-    #pragma omp parallel sections num_threads(2)
-    {
-        #pragma omp section
-        {
-            waitControll();
-        }
-        #pragma omp section
-        {
-            waitCommunication();
-        }
+    inicjujFirme(f);
+    tliczniki * liczniki = otworzLiczniki(f.id);
+    if (liczniki == NULL) {
+        fprintf(stderr, "Firma <%d> nie moze utworzyc licznikow we wspoldzielonej pamieci\n", f.id);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    podlaczLiczniki(f, liczniki);
+    ustawObsluge(f);
+    silnik.doWyslania.resize(f.monitor >= 0 ? f.N + 1 : f.N);
+    if (f.trybKliniki == KLINIKA_KWORUM && f.id == 0)
+        printf("Kworum firmy 0 liczy %d firm z %d\n", (int) f.kworum.size(), f.N);
+    if (wezly.wlaczone && f.id == 0)
+        printf("Wezel firmy 0 liczy %d firm, liderow innych wezlow %d\n", wezly.rozmiar, (int) wezly.liderzy.size());
+
+    tdziennik dziennik;
+    if (!otworzDziennik(&dziennik, prefiksDziennika, f.id, f.N)) {
+        fprintf(stderr, "Firma <%d> nie moze otworzyc dziennika %s.%d.bin\n", f.id, prefiksDziennika, f.id);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
+    silnik.dziennik = &dziennik;
+    std::thread piszacy(watekPiszacy, &dziennik);
+
+    tkanal kanal;
+    kanal.pobudka = false;
+    silnik.kanal = &kanal;
+    std::thread sterujacy(watekSterujacy, &kanal);
+
+    // Silnik dziala do chwili, gdy wszystkie firmy skoncza rundy
+    startBenchmarku(f, sekundy);
+    if (o.nagranie[0] != '\0' && !otworzNagranie(o.nagranie, f, o.ziarno + f.id)) {
+        fprintf(stderr, "Firma <%d> nie moze otworzyc nagrania %s.%d.bin\n", f.id, o.nagranie, f.id);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    silnikProtokolu(f);
+    if (silnik.nagranie != NULL) fclose(silnik.nagranie);
+
+    zlecPolecenie(&kanal, POLECENIE_KONIEC);
+    sterujacy.join();
+    dziennik.koniec.store(true, std::memory_order_release);
+    piszacy.join();
+    fclose(dziennik.plik);
+    zamknijLiczniki(liczniki, f.id);
+    if (licznikiRma) zamknijLicznikiRma();
+    zamknijWezly();
+
+    if (f.benchmark) raportBenchmarku(f);
 
-    printf("%d %d : KONIEC PRACY PROCESU!!!\n", lamport, id);
-    */
+    MPI_Type_free(&typPakietu);
     MPI_Finalize();
     return 0;
 }
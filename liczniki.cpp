@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include "liczniki.h"
+
+/*
+ * Podglad licznikow idiokracji
+ *
+ * Czyta liczniki firm z pamieci wspoldzielonej, ktora idiokracja tworzy na
+ * czas pracy, i wypisuje je w tabeli, np. co 2 sekundy:
+ *
+ *     ./liczniki.out -n 2
+ *
+ * Dziala tylko na wezle, na ktorym pracuja firmy. Czas biezacego pobytu
+ * w stanie jest liczony do ostatniego zdarzenia firmy.
+ *
+*/
+
+const char * skrotStanu[LICZBA_STANOW] = {"1", "2a", "2b", "3", "4", "koniec"};
+
+tliczniki * otworz(int id) {
+    char nazwa[64];
+    snprintf(nazwa, sizeof(nazwa), NAZWA_LICZNIKOW, id);
+    int fd = shm_open(nazwa, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    void * p = mmap(NULL, sizeof(tliczniki), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    tliczniki * l = (tliczniki *) p;
+    if (memcmp(l->magia, "IDZL", 4) != 0 || l->wersja != WERSJA_LICZNIKOW) {
+        munmap(p, sizeof(tliczniki));
+        return NULL;
+    }
+    return l;
+}
+
+void wypisz(tliczniki * l, bool tagi) {
+    double czas[LICZBA_STANOW], suma = 0;
+    for (int s = 0; s < LICZBA_STANOW; s++) {
+        czas[s] = l->czasStanu[s];
+        if (s == l->stan) czas[s] += l->aktualizacja - l->wejscieDoStanu;
+        suma += czas[s];
+    }
+
+    printf("%5d %-6s %9d", l->id, l->stan < LICZBA_STANOW ? skrotStanu[l->stan] : "?", l->lamport);
+    for (int s = 0; s < STAN_KONIEC; s++)
+        printf(" %5.1f%% %6lld", suma > 0 ? 100.0 * czas[s] / suma : 0.0, l->wejscia[s]);
+    printf(" %4d/%-4d %4d/%-4d %7.1f %6d %8.3f %8.3f\n", l->klinikaCzeka, l->klinikaCzekaMax,
+           l->okienkaCzeka, l->okienkaCzekaMax,
+           l->dryfWiadomosci > 0 ? (double) l->dryfSuma / l->dryfWiadomosci : 0.0, l->dryfMax,
+           l->czasWysylania, l->czasBezczynny);
+
+    if (!tagi) return;
+    for (int s = 0; s < LICZBA_STANOW; s++) {
+        bool pusty = true;
+        for (int t = 0; t < LICZBA_TAGOW; t++) {
+            if (l->obsluzone[s][t] == 0) continue;
+            if (pusty) printf("      %-6s", skrotStanu[s]);
+            printf(" %s %lld", nazwaTagu[t], l->obsluzone[s][t]);
+            pusty = false;
+        }
+        if (!pusty) printf("\n");
+    }
+}
+
+int main(int argc, char * argv[]) {
+    int co = 0;
+    bool tagi = false;
+    int opcja;
+    while ((opcja = getopt(argc, argv, "n:t")) != -1) {
+        switch (opcja) {
+        case 'n': // Odswiezanie co tyle sekund
+            co = atoi(optarg);
+            break;
+        case 't': // Obsluzone zdarzenia wg stanu i tagu
+            tagi = true;
+            break;
+        default:
+            printf("Uruchomienie: %s [-n sekundy] [-t]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    tliczniki * pierwsza = otworz(0);
+    if (pierwsza == NULL) {
+        fprintf(stderr, "Brak licznikow firmy 0, czy idiokracja pracuje na tym wezle?\n");
+        return 1;
+    }
+    int N = pierwsza->N;
+    tliczniki ** liczniki = new tliczniki * [N];
+    liczniki[0] = pierwsza;
+    for (int i = 1; i < N; i++)
+        liczniki[i] = otworz(i);
+
+    while (1) {
+        printf("%5s %-6s %9s", "firma", "stan", "lamport");
+        for (int s = 0; s < STAN_KONIEC; s++)
+            printf(" %6s %6s", skrotStanu[s], "wejsc");
+        printf(" %9s %9s %7s %6s %8s %8s\n", "klinika", "okienka", "dryf", "max", "wysyl s", "bezcz s");
+        for (int i = 0; i < N; i++)
+            if (liczniki[i] != NULL) wypisz(liczniki[i], tagi);
+        fflush(stdout);
+        if (co <= 0) break;
+        sleep(co);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef LICZNIKI_H
+#define LICZNIKI_H
+
+#include "protokol.h"
+
+/*
+ * Liczniki pracy firmy
+ *
+ * Firma aktualizuje liczniki po kazdym obsluzonym zdarzeniu. W idiokracji
+ * leza one we wspoldzielonej pamieci /idiokracja.<id>, wiec mozna je czytac
+ * w trakcie pracy, np. przez ./liczniki.out na tym samym wezle. Kazde pole
+ * pisze tylko silnik firmy, czytelnik moze wiec zobaczyc pola z roznych
+ * chwil, ale nigdy wartosci rozerwanej w polowie.
+ *
+*/
+
+#define WERSJA_LICZNIKOW   3
+#define NAZWA_LICZNIKOW    "/idiokracja.%d" // Nazwa segmentu dla shm_open(), %d to id firmy
+
+typedef struct {
+    char magia[4];          // "IDZL"
+    int wersja;             // WERSJA_LICZNIKOW
+    int id;
+    int N;
+
+    // Stan w chwili ostatniego zdarzenia
+    int stan;
+    int lamport;
+    double aktualizacja;    // czasSilnika() ostatniego zdarzenia
+    double wejscieDoStanu;  // czasSilnika() wejscia do biezacego stanu
+
+    // Czas i liczba pobytow w kazdym stanie, czas bez biezacego pobytu
+    double czasStanu[LICZBA_STANOW];
+    long long wejscia[LICZBA_STANOW];
+
+    // Obsluzone zdarzenia wg stanu, w ktorym nadeszly, i tagu
+    long long obsluzone[LICZBA_STANOW][LICZBA_TAGOW];
+
+    // Odlozone zadania innych firm, w trybie kworum takze czekajace u arbitra
+    int klinikaCzeka, klinikaCzekaMax;
+    int okienkaCzeka, okienkaCzekaMax;
+
+    // O ile zegar Lamporta z wiadomosci wyprzedzal nasz
+    int dryfMax;
+    long long dryfSuma;
+    long long dryfWiadomosci; // Wiadomosci z zegarem wiekszym od naszego
+
+    // Silnik MPI
+    double czasWysylania;   // W wysylaniu paczek
+    double czasBezczynny;   // W sched_yield() i usleep(), gdy nic nie nadchodzi
+} tliczniki;
+
+#endif
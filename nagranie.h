@@ -0,0 +1,53 @@
+#ifndef NAGRANIE_H
+#define NAGRANIE_H
+
+/*
+ * Nagranie przebiegu firmy do powtorki
+ *
+ * Logika firmy zalezy tylko od kolejnosci i tresci zdarzen, ktore dostaje od
+ * silnika, od losowan rand() i od czasu. Przy nagrywaniu (-n prefiks) silnik
+ * zapisuje wiec kazde zdarzenie firmy w kolejnosci obslugi razem z czasem,
+ * ktory firma widzi przez czasSilnika() do konca zdarzenia. Losowania
+ * wyznacza ziarno z naglowka. ./powtorka.out odtwarza z nagran te same
+ * przebiegi bez MPI i bez czekania:
+ *
+ *     mpirun -np 4 ./idiokracja.out -n nagranie -s 10 8 2
+ *     ./powtorka.out nagranie.*.bin
+ *
+ * Plik nagrania to naglowek, a po nim zdarzenia w kolejnosci obslugi.
+ *
+*/
+
+#define WERSJA_NAGRANIA    1
+
+// Rodzaje zdarzen w nagraniu
+#define NAGRANIE_START        0 // uruchomFirme
+#define NAGRANIE_WIADOMOSC    1 // obsluzWiadomosc
+#define NAGRANIE_POBUDKA      2 // obsluzPobudke
+#define NAGRANIE_ZATRZYMANIE  3 // zatrzymajFirme
+
+typedef struct {
+    char magia[4];     // "IDZN"
+    int wersja;        // WERSJA_NAGRANIA
+    int id;
+    int N;             // Liczba firm, bez monitora
+    int K, L;
+    int monitor;       // Id monitora, -1 gdy bez niego
+    int trybKliniki, trybOkna;
+    int maxIdiotow, czasIdiotow, czasKliniki, czasOkna;
+    int maxRund;
+    unsigned ziarno;   // Argument srand() firmy
+    int benchmark;
+    double czasStartu;
+    double czasKonca;
+} tnaglowekNagrania;
+
+typedef struct {
+    double czas;           // czasSilnika() w trakcie zdarzenia
+    unsigned char rodzaj;  // NAGRANIE_*
+    unsigned char tag;     // Tag wiadomosci
+    unsigned short zrodlo; // Nadawca wiadomosci
+    int pid, tim, val;     // Tresc wiadomosci
+} tzdarzenieNagrania;
+
+#endif
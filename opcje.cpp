@@ -0,0 +1,206 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include "opcje.h"
+
+void domyslneOpcje(topcje &o) {
+    o.cicho = false;
+    o.N = -1;
+    o.K = -1;
+    o.L = -1;
+    o.trybKliniki = KLINIKA_RICART;
+    o.trybOkna = OKNO_RICART;
+    o.blokujace = false;
+    o.monitor = false;
+    o.wezly = 0;
+    strcpy(o.dziennik, "dziennik");
+    o.nagranie[0] = '\0';
+    o.poziom = DZIENNIK_POZIOM;
+    o.rundy = 0;
+    o.sekundy = 0;
+    o.ziarno = time(NULL);
+    o.maxIdiotow = max_idiots;
+    o.czasIdiotow = max_wait_i;
+    o.czasKliniki = max_wait_k;
+    o.czasOkna = max_wait_o;
+    o.opoznienie = 50;
+    o.rozrzut = 0;
+}
+
+// Nieujemna liczba calkowita, cala wartosc musi byc liczba
+bool liczba(const char * wartosc, int &wynik) {
+    char * koniec;
+    errno = 0;
+    long v = strtol(wartosc, &koniec, 10);
+    if (koniec == wartosc || *koniec != '\0' || errno != 0 || v < 0 || v > 1000000000) return false;
+    wynik = (int) v;
+    return true;
+}
+
+bool wybor(const char * wartosc, const char * nazwy[], int ile, int &wynik) {
+    for (int i = 0; i < ile; i++)
+        if (strcmp(wartosc, nazwy[i]) == 0) {
+            wynik = i;
+            return true;
+        }
+    return false;
+}
+
+// Nazwy trybow w kolejnosci ich stalych KLINIKA_* i OKNO_*
+const char * trybyKliniki[] = {"ricart", "semafor", "kworum", "rma"};
+const char * trybyOkna[]    = {"ricart", "kworum", "zeton", "rma"};
+
+bool ustawOpcje(topcje &o, const char * klucz, const char * wartosc) {
+    int v;
+    if (strcmp(klucz, "klinika") == 0) return wybor(wartosc, trybyKliniki, 4, o.trybKliniki);
+    if (strcmp(klucz, "okna") == 0)    return wybor(wartosc, trybyOkna, 4, o.trybOkna);
+    if (strcmp(klucz, "dziennik") == 0) {
+        if (strlen(wartosc) == 0 || strlen(wartosc) >= sizeof(o.dziennik)) return false;
+        strcpy(o.dziennik, wartosc);
+        return true;
+    }
+    if (strcmp(klucz, "nagranie") == 0) {
+        if (strlen(wartosc) >= sizeof(o.nagranie)) return false;
+        strcpy(o.nagranie, wartosc);
+        return true;
+    }
+
+    if (!liczba(wartosc, v)) return false;
+    if      (strcmp(klucz, "firmy") == 0)        o.N = v;
+    else if (strcmp(klucz, "miejsca") == 0)      o.K = v;
+    else if (strcmp(klucz, "okienka") == 0)      o.L = v;
+    else if (strcmp(klucz, "blokujace") == 0)    o.blokujace = v != 0;
+    else if (strcmp(klucz, "monitor") == 0)      o.monitor = v != 0;
+    else if (strcmp(klucz, "wezly") == 0)        o.wezly = v;
+    else if (strcmp(klucz, "poziom") == 0)       o.poziom = v;
+    else if (strcmp(klucz, "rundy") == 0)        o.rundy = v;
+    else if (strcmp(klucz, "sekundy") == 0)      o.sekundy = v;
+    else if (strcmp(klucz, "ziarno") == 0)       o.ziarno = v;
+    else if (strcmp(klucz, "idioci") == 0)       o.maxIdiotow = v;
+    else if (strcmp(klucz, "czas_idiotow") == 0) o.czasIdiotow = v;
+    else if (strcmp(klucz, "czas_kliniki") == 0) o.czasKliniki = v;
+    else if (strcmp(klucz, "czas_okna") == 0)    o.czasOkna = v;
+    else if (strcmp(klucz, "opoznienie") == 0)   o.opoznienie = v;
+    else if (strcmp(klucz, "rozrzut") == 0)      o.rozrzut = v;
+    else return false;
+    return true;
+}
+
+bool ustawKrotka(topcje &o, int opcja, const char * arg) {
+    switch (opcja) {
+    case 'c': return wczytajKonfiguracje(o, arg);
+    case 'b': return ustawOpcje(o, "blokujace", "1");
+    case 'm': return ustawOpcje(o, "monitor", "1");
+    case 'H': return ustawOpcje(o, "wezly", arg);
+    case 'w': return ustawOpcje(o, "klinika", "semafor");
+    case 'q': return ustawOpcje(o, "klinika", "kworum") && ustawOpcje(o, "okna", "kworum");
+    case 't': return ustawOpcje(o, "okna", "zeton");
+    case 'a': return ustawOpcje(o, "klinika", "rma") && ustawOpcje(o, "okna", "rma");
+    case 'd': return ustawOpcje(o, "dziennik", arg);
+    case 'v': return ustawOpcje(o, "poziom", arg);
+    case 'n': return ustawOpcje(o, "nagranie", arg);
+    case 'r': return ustawOpcje(o, "rundy", arg);
+    case 's': return ustawOpcje(o, "sekundy", arg);
+    case 'z': return ustawOpcje(o, "ziarno", arg);
+    case 'X': return ustawOpcje(o, "idioci", arg);
+    case 'I': return ustawOpcje(o, "czas_idiotow", arg);
+    case 'C': return ustawOpcje(o, "czas_kliniki", arg);
+    case 'O': return ustawOpcje(o, "czas_okna", arg);
+    case 'l': return ustawOpcje(o, "opoznienie", arg);
+    case 'j': return ustawOpcje(o, "rozrzut", arg);
+    }
+    return false;
+}
+
+bool opcjaKrotka(topcje &o, int opcja, const char * arg) {
+    bool dobrze = ustawKrotka(o, opcja, arg);
+    if (!dobrze && arg != NULL && opcja != 'c' && !o.cicho)
+        fprintf(stderr, "Zla wartosc opcji -%c: %s\n", opcja, arg);
+    return dobrze;
+}
+
+// Usuwa biale znaki z poczatku i konca napisu
+char * przytnij(char * s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char * k = s + strlen(s);
+    while (k > s && (k[-1] == ' ' || k[-1] == '\t' || k[-1] == '\n' || k[-1] == '\r')) k--;
+    *k = '\0';
+    return s;
+}
+
+bool wczytajKonfiguracje(topcje &o, const char * plik) {
+    FILE * f = fopen(plik, "r");
+    if (f == NULL) {
+        if (!o.cicho) fprintf(stderr, "Nie mozna otworzyc konfiguracji %s\n", plik);
+        return false;
+    }
+    char wiersz[512];
+    int numer = 0;
+    bool dobrze = true;
+    while (fgets(wiersz, sizeof(wiersz), f) != NULL) {
+        numer++;
+        char * komentarz = strchr(wiersz, '#');
+        if (komentarz != NULL) *komentarz = '\0';
+        char * w = przytnij(wiersz);
+        if (*w == '\0') continue;
+        char * rowna = strchr(w, '=');
+        if (rowna == NULL) {
+            if (!o.cicho) fprintf(stderr, "%s:%d: brak '=' w \"%s\"\n", plik, numer, w);
+            dobrze = false;
+            continue;
+        }
+        *rowna = '\0';
+        char * klucz = przytnij(w);
+        char * wartosc = przytnij(rowna + 1);
+        if (!ustawOpcje(o, klucz, wartosc)) {
+            if (!o.cicho) fprintf(stderr, "%s:%d: nieznany klucz lub zla wartosc \"%s = %s\"\n", plik, numer, klucz, wartosc);
+            dobrze = false;
+        }
+    }
+    fclose(f);
+    return dobrze;
+}
+
+bool sprawdzOpcje(const topcje &o, int N) {
+    const char * blad = NULL;
+    if (N < 1)                                   blad = "potrzebna co najmniej jedna firma";
+    else if (N > 65535)                          blad = "firm moze byc co najwyzej 65535, tyle miesci 16-bitowy numer nadawcy";
+    else if (o.N >= 0 && o.N != N)               blad = "liczba firm z konfiguracji rozna od uruchomionej";
+    else if (o.K < 1)                            blad = "K musi byc co najmniej 1";
+    else if (o.L < 1)                            blad = "L musi byc co najmniej 1";
+    else if (o.maxIdiotow < 2)                   blad = "X musi byc co najmniej 2";
+    else if (o.poziom > DZIENNIK_POZIOM)         blad = "poziom dziennika wiekszy niz skompilowany DZIENNIK_POZIOM";
+    else if (o.nagranie[0] != '\0' && (o.trybKliniki == KLINIKA_RMA || o.trybOkna == OKNO_RMA))
+                                                 blad = "nagranie nie obejmuje wynikow operacji na licznikach rma";
+    else if (o.wezly > 0 && o.trybKliniki != KLINIKA_RICART && o.trybOkna != OKNO_RICART)
+                                                 blad = "wezly dzialaja tylko z klinika lub okienkami w trybie ricart";
+    else if (o.wezly > 0 && o.nagranie[0] != '\0') blad = "nagranie nie obejmuje przydzialow liderow wezlow";
+#ifdef STALE_N
+    else if (N != STALE_N)                       blad = "liczba firm rozna od STALE_N z kompilacji";
+#endif
+#ifdef STALE_K
+    else if (o.K != STALE_K)                     blad = "K rozne od STALE_K z kompilacji";
+#endif
+#ifdef STALE_L
+    else if (o.L != STALE_L)                     blad = "L rozne od STALE_L z kompilacji";
+#endif
+    if (blad != NULL && !o.cicho) fprintf(stderr, "Zle parametry: %s\n", blad);
+    return blad == NULL;
+}
+
+void ustawFirme(tfirma &f, const topcje &o) {
+    f.K = o.K;
+    f.L = o.L;
+    f.trybKliniki = o.trybKliniki;
+    f.trybOkna = o.trybOkna;
+    f.wezly = o.wezly > 0;
+    f.rozsylanieBlokujace = o.blokujace;
+    f.poziomDziennika = o.poziom;
+    f.maxIdiotow = o.maxIdiotow;
+    f.czasIdiotow = o.czasIdiotow;
+    f.czasKliniki = o.czasKliniki;
+    f.czasOkna = o.czasOkna;
+    f.maxRund = o.rundy;
+}
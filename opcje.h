@@ -0,0 +1,65 @@
+#ifndef OPCJE_H
+#define OPCJE_H
+
+#include "firma.h"
+
+/*
+ * Parametry pracy firm, wspolne dla idiokracji i symulatora
+ *
+ * Kazdy parametr ma klucz, pod ktorym mozna go podac w pliku konfiguracji
+ * (-c plik), a wiekszosc takze krotka opcje. Plik ma w kazdym wierszu
+ * "klucz = wartosc", a # zaczyna komentarz, np.:
+ *
+ *     # 8 miejsc, 2 okienka, klinika w trybie kworum
+ *     miejsca = 8
+ *     okienka = 2
+ *     klinika = kworum
+ *     rundy   = 100
+ *
+ * Opcje sa stosowane w kolejnosci podania, wiec w "-c plik -r 5" liczba
+ * rund z wiersza polecen zastepuje te z pliku.
+ *
+*/
+
+typedef struct {
+    bool cicho;            // Bez wypisywania bledow, np. w procesach MPI innych niz 0
+    int N;                 // firmy, -1 gdy nie podano
+    int K;                 // miejsca, -1 gdy nie podano
+    int L;                 // okienka, -1 gdy nie podano
+    int trybKliniki;       // klinika = ricart | semafor | kworum | rma
+    int trybOkna;          // okna = ricart | kworum | zeton | rma
+    bool blokujace;        // blokujace = 0 | 1, paczki przez MPI_Send
+    bool monitor;          // monitor = 0 | 1, ostatni proces jest monitorem
+    int wezly;             // wezly = 0 | 1 | n, tryby Ricarta przez liderow wezlow: 1 wg wspolnej pamieci, n po n procesow, tylko idiokracja
+    char dziennik[256];    // dziennik = prefiks plikow dziennika
+    char nagranie[256];    // nagranie = prefiks plikow nagrania do powtorki, pusty gdy bez nagrania
+    int poziom;            // poziom = 0 .. DZIENNIK_POZIOM, zapisy powyzej nie trafiaja do dziennika
+    int rundy;             // rundy, 0 gdy bez ograniczenia
+    int sekundy;           // sekundy, 0 gdy bez ograniczenia
+    unsigned ziarno;       // ziarno losowania, domyslnie z zegara
+    int maxIdiotow;        // idioci
+    int czasIdiotow;       // czas_idiotow w ms
+    int czasKliniki;       // czas_kliniki w ms
+    int czasOkna;          // czas_okna w ms
+    int opoznienie;        // opoznienie w us, tylko symulator
+    int rozrzut;           // rozrzut w us, tylko symulator
+} topcje;
+
+void domyslneOpcje(topcje &o);
+
+// Ustawia parametr o danym kluczu, zwraca false przy nieznanym kluczu lub zlej wartosci
+bool ustawOpcje(topcje &o, const char * klucz, const char * wartosc);
+
+// Krotka opcja z getopt, w tym -c plik, zwraca false przy nieznanej opcji lub zlej wartosci
+bool opcjaKrotka(topcje &o, int opcja, const char * arg);
+
+// Wczytuje plik konfiguracji, bledy wypisuje na stderr z numerem wiersza
+bool wczytajKonfiguracje(topcje &o, const char * plik);
+
+// Sprawdza zakresy i zgodnosc z rozmiarami STALE_*, N to liczba firm, przy bledzie wypisuje powod
+bool sprawdzOpcje(const topcje &o, int N);
+
+// Przepisuje parametry do firmy przed inicjujFirme
+void ustawFirme(tfirma &f, const topcje &o);
+
+#endif
@@ -0,0 +1,274 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <getopt.h>
+#include "firma.h"
+#include "nagranie.h"
+
+/*
+ * Powtorka nagranego przebiegu idiokracji
+ *
+ * Czyta nagrania firm z idiokracja.out -n i kazdej firmie z firma.cpp podaje
+ * po kolei jej zdarzenia z nagrania, z tym samym ziarnem rand() i tym samym
+ * czasem. Firma przechodzi wiec dokladnie te same stany co w nagraniu, ale bez
+ * MPI i bez czekania, np. zeby odtworzyc rzadki przypadek pod debuggerem:
+ *
+ *     ./powtorka.out -f 2 nagranie.*.bin
+ *
+ * Wiadomosci wysylane w powtorce nie trafiaja do innych firm, bo te maja
+ * swoje zdarzenia z nagran. Powtorka sprawdza za to, czy wiadomosci, ktore
+ * odebrala firma j od firmy i, sa poczatkiem tych, ktore firma i wyslala do j
+ * w powtorce. Rozbieznosc oznacza, ze przebieg zalezy od czegos spoza
+ * nagrania.
+ *
+*/
+
+typedef struct {
+    int tag;
+    tmessage message;
+} twyslana;
+
+typedef struct {
+    tnaglowekNagrania naglowek;
+    std::vector<tzdarzenieNagrania> zdarzenia;
+    tfirma f;
+    tliczniki liczniki;
+    std::vector<std::vector<twyslana> > wyslane; // Wiadomosci wyslane w powtorce wg odbiorcy
+} tpowtorka;
+
+std::vector<tpowtorka> firmy;
+int biezaca;  // Firma, ktorej zdarzenia powtarzamy
+double teraz; // Czas biezacego zdarzenia z nagrania
+
+const char * nazwaRodzaju[] = {"START", "WIADOMOSC", "POBUDKA", "ZATRZYMANIE"};
+
+// SILNIK-----------------------------------------------------------------------
+
+void nadaj(tfirma &f, int cel, int tag, tmessage &message) {
+    if (cel == f.monitor) return;
+    twyslana w;
+    w.tag = tag;
+    w.message = message;
+    firmy[biezaca].wyslane[cel].push_back(w);
+}
+
+// Pobudki sa zdarzeniami z nagrania, wiec odliczac nie trzeba
+void odliczCzas(tfirma &f, int ms) {
+}
+
+double czasSilnika() {
+    return teraz;
+}
+
+void zakonczPrace(tfirma &f) {
+}
+
+// Nagran z trybu licznikow nie ma, sprawdzOpcje odrzuca nagrywanie z wezlami, a wczytaj nagrania z rma
+int zajmijLicznik(tfirma &f, int z, int ile) {
+    return 0;
+}
+
+void zwolnijLicznik(tfirma &f, int z, int ile) {
+}
+
+// POWTORKA---------------------------------------------------------------------
+
+bool wczytaj(const char * nazwa, tpowtorka &p) {
+    FILE * plik = fopen(nazwa, "rb");
+    if (plik == NULL) {
+        fprintf(stderr, "Nie mozna otworzyc %s\n", nazwa);
+        return false;
+    }
+    if (fread(&p.naglowek, sizeof(p.naglowek), 1, plik) != 1 || memcmp(p.naglowek.magia, "IDZN", 4) != 0) {
+        fprintf(stderr, "%s nie jest nagraniem idiokracji\n", nazwa);
+        fclose(plik);
+        return false;
+    }
+    if (p.naglowek.wersja != WERSJA_NAGRANIA) {
+        fprintf(stderr, "%s ma nagranie w wersji %d, a powtorka zna wersje %d\n", nazwa, p.naglowek.wersja, WERSJA_NAGRANIA);
+        fclose(plik);
+        return false;
+    }
+    if (p.naglowek.trybKliniki == KLINIKA_RMA || p.naglowek.trybOkna == OKNO_RMA) {
+        fprintf(stderr, "%s pochodzi z trybu licznikow rma, ktorego nie da sie powtorzyc\n", nazwa);
+        fclose(plik);
+        return false;
+    }
+    tzdarzenieNagrania z;
+    while (fread(&z, sizeof(z), 1, plik) == 1) // Niepelne ostatnie zdarzenie pomijamy
+        p.zdarzenia.push_back(z);
+    fclose(plik);
+    return true;
+}
+
+// Odtwarza firme z naglowka nagrania, tak jak przygotowal ja silnik przed uruchomFirme
+void przygotuj(tpowtorka &p) {
+    tnaglowekNagrania &n = p.naglowek;
+    tfirma &f = p.f;
+    f.id = n.id;
+    f.N = n.N;
+    f.K = n.K;
+    f.L = n.L;
+    f.monitor = n.monitor;
+    f.trybKliniki = n.trybKliniki;
+    f.trybOkna = n.trybOkna;
+    f.wezly = false; // Nagrania z trybu wezlow nie ma, sprawdzOpcje go odrzuca
+    f.rozsylanieBlokujace = false;
+    f.poziomDziennika = POZIOM_BRAK;
+    f.maxIdiotow = n.maxIdiotow;
+    f.czasIdiotow = n.czasIdiotow;
+    f.czasKliniki = n.czasKliniki;
+    f.czasOkna = n.czasOkna;
+    f.maxRund = n.maxRund;
+    f.benchmark = n.benchmark;
+    inicjujBenchmark(f);
+    f.czasStartu = n.czasStartu;
+    f.czasKonca = n.czasKonca;
+    inicjujFirme(f);
+    podlaczLiczniki(f, &p.liczniki);
+    p.wyslane.resize(f.N);
+}
+
+void powtorz(int i, bool slad) {
+    tpowtorka &p = firmy[i];
+    tfirma &f = p.f;
+    biezaca = i;
+    srand(p.naglowek.ziarno);
+    for (size_t k = 0; k < p.zdarzenia.size(); k++) {
+        tzdarzenieNagrania &z = p.zdarzenia[k];
+        teraz = z.czas;
+        int stan = f.stan;
+        tmessage m;
+        m.pid = z.pid;
+        m.tim = z.tim;
+        m.val = z.val;
+        switch (z.rodzaj) {
+        case NAGRANIE_START:
+            uruchomFirme(f);
+            break;
+        case NAGRANIE_WIADOMOSC:
+            obsluzWiadomosc(f, z.tag, m, z.zrodlo);
+            break;
+        case NAGRANIE_POBUDKA:
+            obsluzPobudke(f);
+            break;
+        case NAGRANIE_ZATRZYMANIE:
+            zatrzymajFirme(f);
+            break;
+        default:
+            fprintf(stderr, "Firma <%d>: nieznany rodzaj zdarzenia %d w zdarzeniu %zu\n", f.id, z.rodzaj, k);
+            continue;
+        }
+        if (slad)
+            printf("%10.6f %d %d : Firma <%d> %s %s od <%d> tim %d val %d, %s -> %s\n",
+                   z.czas - f.czasStartu, f.lamport, f.id, f.id,
+                   z.rodzaj <= NAGRANIE_ZATRZYMANIE ? nazwaRodzaju[z.rodzaj] : "?",
+                   z.tag < LICZBA_TAGOW ? nazwaTagu[z.tag] : "?", z.zrodlo, z.tim, z.val,
+                   opisStanu[stan], opisStanu[f.stan]);
+    }
+}
+
+// Odebrane przez firme j od firmy i musza byc poczatkiem wyslanych przez i do j w powtorce
+long long sprawdzZgodnosc(int i, int j) {
+    tpowtorka &nadawca = firmy[i], &odbiorca = firmy[j];
+    std::vector<twyslana> &wyslane = nadawca.wyslane[odbiorca.f.id];
+    size_t k = 0;
+    for (size_t e = 0; e < odbiorca.zdarzenia.size(); e++) {
+        tzdarzenieNagrania &z = odbiorca.zdarzenia[e];
+        if (z.rodzaj != NAGRANIE_WIADOMOSC || z.zrodlo != nadawca.f.id) continue;
+        if (k >= wyslane.size()) {
+            printf("ROZBIEZNOSC: firma <%d> odebrala od <%d> wiecej niz %zu wiadomosci wyslanych w powtorce\n",
+                   odbiorca.f.id, nadawca.f.id, wyslane.size());
+            return 1;
+        }
+        twyslana &w = wyslane[k];
+        if (w.tag != z.tag || w.message.pid != z.pid || w.message.tim != z.tim || w.message.val != z.val) {
+            printf("ROZBIEZNOSC: firma <%d> odebrala od <%d> jako %zu. wiadomosc %s tim %d val %d, "
+                   "a w powtorce <%d> wyslala %s tim %d val %d\n",
+                   odbiorca.f.id, nadawca.f.id, k + 1,
+                   z.tag < LICZBA_TAGOW ? nazwaTagu[z.tag] : "?", z.tim, z.val, nadawca.f.id,
+                   w.tag < LICZBA_TAGOW ? nazwaTagu[w.tag] : "?", w.message.tim, w.message.val);
+            return 1;
+        }
+        k++;
+    }
+    return 0;
+}
+
+double czasScienny() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char * argv[]) {
+    int sledzona = -1;
+    int opcja;
+    while ((opcja = getopt(argc, argv, "f:")) != -1) {
+        switch (opcja) {
+        case 'f': // Wypisuje kazde zdarzenie tej firmy ze zmiana stanu
+            sledzona = atoi(optarg);
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if (argc - optind < 1) {
+        printf("Uruchomienie: %s [-f firma] <nagranie.bin>...\n", argv[0]);
+        return -1;
+    }
+
+    firmy.resize(argc - optind);
+    for (int i = 0; i < (int) firmy.size(); i++)
+        if (!wczytaj(argv[optind + i], firmy[i]))
+            return 1;
+    for (int i = 1; i < (int) firmy.size(); i++) {
+        tnaglowekNagrania &a = firmy[0].naglowek, &b = firmy[i].naglowek;
+        if (a.N != b.N || a.trybKliniki != b.trybKliniki || a.trybOkna != b.trybOkna || a.monitor != b.monitor) {
+            fprintf(stderr, "Nagrania %s i %s pochodza z roznych przebiegow\n", argv[optind], argv[optind + i]);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < (int) firmy.size(); i++)
+        przygotuj(firmy[i]);
+    ustawObsluge(firmy[0].f); // Tablica obslugi jest wspolna, tryby wszystkich firm sa te same
+
+    double start = czasScienny();
+    long long zdarzenia = 0;
+    for (int i = 0; i < (int) firmy.size(); i++) {
+        powtorz(i, firmy[i].f.id == sledzona);
+        zdarzenia += firmy[i].zdarzenia.size();
+    }
+    double sciennie = czasScienny() - start;
+
+    std::vector<long long> opoznienia[2];
+    opoznienia[ZASOB_KLINIKA].assign(KUBELKI_OPOZNIEN, 0);
+    opoznienia[ZASOB_OKNO].assign(KUBELKI_OPOZNIEN, 0);
+    long long wiadomosci = 0;
+    double czas = 0;
+    for (int i = 0; i < (int) firmy.size(); i++) {
+        tfirma &f = firmy[i].f;
+        printf("firma <%d>: zdarzen %zu, rund %d, %s, zegar %d\n",
+               f.id, firmy[i].zdarzenia.size(), f.rundy, opisStanu[f.stan], f.lamport);
+        for (int z = 0; z < 2; z++)
+            for (int k = 0; k < KUBELKI_OPOZNIEN; k++)
+                opoznienia[z][k] += f.opoznienia[z][k];
+        wiadomosci += f.wyslane;
+        if (f.czasPracy > czas) czas = f.czasPracy;
+    }
+    tfirma &f = firmy[0].f;
+    printf("\nPowtorka: %d z %d firm, K = %d, L = %d, czas nagrania %.3f s\n", (int) firmy.size(), f.N, f.K, f.L, czas);
+    wypiszWyniki(f, czas, opoznienia, wiadomosci, -1);
+    printf("zdarzen %lld w %.3f s, %.0f zdarzen/s\n", zdarzenia, sciennie, sciennie > 0 ? zdarzenia / sciennie : 0.0);
+
+    long long rozbieznosci = 0;
+    for (int i = 0; i < (int) firmy.size(); i++)
+        for (int j = 0; j < (int) firmy.size(); j++)
+            if (i != j) rozbieznosci += sprawdzZgodnosc(i, j);
+    if (rozbieznosci == 0)
+        printf("wiadomosci odebrane w nagraniach zgodne z wyslanymi w powtorce\n");
+    return rozbieznosci == 0 ? 0 : 2;
+}
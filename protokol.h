@@ -0,0 +1,106 @@
+#ifndef PROTOKOL_H
+#define PROTOKOL_H
+
+/*
+ * Tagi wiadomosci i stany silnika protokolu, wspolne dla idiokracji
+ * i narzedzi czytajacych jej dziennik.
+ *
+*/
+
+// Message Tags
+#define INSIDE           0 // Zdarzenie lokalne od watku sterujacego, nie jest wysylane przez MPI
+#define KLINIKA_REQUEST  1
+#define KLINIKA_AGREE    2
+#define OKNO_REQUEST     3
+#define OKNO_AGREE       4
+#define KLINIKA_RELEASE  5 // Tryb semafora: nowa liczba miejsc zajmowanych przez nadawce
+
+// Tagi trybu kworum dla kliniki, dla okienek przesuniete o KWORUM_TYPY
+#define KWORUM_REQUEST   6
+#define KWORUM_GRANT     7
+#define KWORUM_FAILED    8
+#define KWORUM_INQUIRE   9
+#define KWORUM_YIELD     10
+#define KWORUM_RELEASE   11
+#define KWORUM_UPDATE    12 // Nowa liczba jednostek zasobu zajmowanych przez nadawce
+#define KWORUM_TYPY      7
+
+// Tagi trybu zetonow dla okienek
+#define OKNO_TOKEN_REQUEST 20 // Prosba do zarzadcy o zeton
+#define OKNO_TOKEN         21 // Przekazanie zetonu, val to id zetonu
+#define OKNO_TOKEN_PASS    22 // Polecenie zarzadcy oddania zetonu, val to zeton * N + odbiorca
+#define OKNO_TOKEN_FREE    23 // Zeton od zarzadcy jest juz wolny, val to id zetonu
+
+// Tagi trybu monitora
+#define MONITOR_KLINIKA    24 // Zgloszenie monitorowi, val to zajmowane miejsca w klinice
+#define MONITOR_OKNO       25 // Zgloszenie monitorowi, val to 1 przy okienku albo 0
+#define MONITOR_ZEGAR      26 // Takt monitora i odpowiedz firmy z jej zegarem
+
+// Zatrzymanie pracy
+#define KONIEC_PRACY       27 // Firma konczy biezaca runde i przechodzi do STAN_KONIEC
+
+// Tag trybu licznikow
+#define LICZNIK_WPUSZCZENIE 28 // Firma z poczatku kolejki licznika dostaje jednostki, val to ich liczba
+
+// Tagi liderow wezlow, val to 2 * jednostki + zasob
+#define WEZEL_REQUEST      29 // Lider prosi o jednostki zasobu dla firm swojego wezla
+#define WEZEL_AGREE        30 // Zgoda, jednostki to liczba trzymana przez wezel nadawcy
+#define WEZEL_RELEASE      31 // Nowa liczba jednostek trzymanych przez wezel nadawcy
+#define LICZBA_TAGOW       32
+
+// Stany silnika protokolu
+#define STAN_1           0 // czekanie na idiotow
+#define STAN_2A          1 // ubieganie sie o miejsce w klinice
+#define STAN_2B          2 // przebywanie w klinice
+#define STAN_3           3 // ubieganie sie o okno
+#define STAN_4           4 // papierkologia
+#define STAN_KONIEC      5 // koniec pracy, odpowiadamy jedynie innym firmom
+#define LICZBA_STANOW    6
+
+// Opisy stanow uzywane w komunikatach
+static const char * opisStanu[LICZBA_STANOW] = {
+    "oczekuje na idiotow",
+    "oczekuje na klinike",
+    "jest w klinice",
+    "oczekuje na okienko",
+    "jest przy oknie",
+    "skonczyla prace"
+};
+
+// Nazwy tagow uzywane w komunikatach
+static const char * nazwaTagu[LICZBA_TAGOW] = {
+    "INSIDE",
+    "KLINIKA_REQUEST",
+    "KLINIKA_AGREE",
+    "OKNO_REQUEST",
+    "OKNO_AGREE",
+    "KLINIKA_RELEASE",
+    "KWORUM_REQUEST",
+    "KWORUM_GRANT",
+    "KWORUM_FAILED",
+    "KWORUM_INQUIRE",
+    "KWORUM_YIELD",
+    "KWORUM_RELEASE",
+    "KWORUM_UPDATE",
+    "OKNO_KWORUM_REQUEST",
+    "OKNO_KWORUM_GRANT",
+    "OKNO_KWORUM_FAILED",
+    "OKNO_KWORUM_INQUIRE",
+    "OKNO_KWORUM_YIELD",
+    "OKNO_KWORUM_RELEASE",
+    "OKNO_KWORUM_UPDATE",
+    "OKNO_TOKEN_REQUEST",
+    "OKNO_TOKEN",
+    "OKNO_TOKEN_PASS",
+    "OKNO_TOKEN_FREE",
+    "MONITOR_KLINIKA",
+    "MONITOR_OKNO",
+    "MONITOR_ZEGAR",
+    "KONIEC_PRACY",
+    "LICZNIK_WPUSZCZENIE",
+    "WEZEL_REQUEST",
+    "WEZEL_AGREE",
+    "WEZEL_RELEASE"
+};
+
+#endif
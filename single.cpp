@@ -1,9 +1,8 @@
 #include <mpi.h>
 
+#include <chrono>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <set>
+#include <vector>
 #include <string>
 #include <iostream>
 
@@ -12,12 +11,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/time.h>
 
-#define INSIDE_TAG		101
-#define REQUEST_TAG		102
-#define AGREE_TAG		103
-
+#include "distributed_mutex.h"
 
 using namespace std;
 
@@ -25,15 +23,48 @@ using namespace std;
 
 struct State {
     int rank, size;
-    bool ready;
-    int lamport;
-    mutex mtx;
-    condition_variable cv;
+    int rounds; // 0 runs until a signal arrives, per worker thread
+    int handoff;
+    int timeout;    // try_lock_for limit in milliseconds
+    int pace;       // microseconds per unit of the random sleeps
+    MutexService *service;
 };
 
 
+// Set by SIGINT, SIGTERM or SIGUSR1, mainloop stops after the current round
+volatile sig_atomic_t stop_requested = 0;
+
+
 // HELPER FUNCTIONS
 
+void on_stop_signal(int signo)
+{
+    stop_requested = 1;
+}
+
+void install_stop_handler()
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+// Threads started while the signals are blocked inherit the mask, so only
+// the main thread takes them and its usleep() is cut short
+void block_stop_signals(bool blocked)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(blocked ? SIG_BLOCK : SIG_UNBLOCK, &signals, NULL);
+}
+
 void randomize(int rank)
 {
     struct timeval tv;
@@ -49,134 +80,48 @@ long microseconds()
     return (long) tv.tv_sec * (long) 1000000 + (long) tv.tv_usec;
 }
 
-void log(struct State *state, char *fmt, ...) {
-    char *str = NULL;
+// Formats the whole line on the stack and writes it at once, without allocating
+void log(struct State *state, const char *fmt, ...) {
+    char line[512];
+    int len = snprintf(line, sizeof(line), "%*d, %*d: ", 4, state->service->clock(), 4, state->rank);
     va_list args;
     va_start(args, fmt);
-    vasprintf(&str, fmt, args);
+    len += vsnprintf(line + len, sizeof(line) - len, fmt, args);
     va_end(args);
-    printf("%*d, %*d: %s\n", 4, state->lamport, 4, state->rank, str);
-    free(str);
-}
-
-
-// Thread routine responsible for MPI communication
-
-void *mpi_thread(void *arg) {
-    struct State *state = (struct State *)arg;
-
-    int buf;
-    MPI::Status status;
-    set<int> queue;
-
-    bool inside = false;
-
-    while (1) {
-        MPI::COMM_WORLD.Recv(&buf, 1, MPI::INT, MPI::ANY_SOURCE, MPI::ANY_TAG, status);
-        state->lamport = max(state->lamport, buf) + 1;
-        switch (status.Get_tag()) {
-            case INSIDE_TAG: // enter/exit
-                if (!inside) {
-                    for (int i = 0; i < state->size; i++) {
-                        if (i != state->rank) {
-                            MPI::COMM_WORLD.Send(&state->lamport, 1, MPI::INT, i, REQUEST_TAG);
-                        }
-                    }
-                    int request_clock = state->lamport;
-                    int replies_received = 0;
-                    while (replies_received < state->size - 1) {
-                        MPI::COMM_WORLD.Recv(&buf, 1, MPI::INT, MPI::ANY_SOURCE, MPI::ANY_TAG, status);
-                        state->lamport = max(state->lamport, buf) + 1;
-                        switch (status.Get_tag()) {
-                            case REQUEST_TAG:
-                                if (request_clock < buf || (buf == request_clock && state->rank < status.Get_source())) {
-                                    // current process has higher priority
-                                    queue.insert(status.Get_source());
-                                } else {
-                                    // other process has higher priority
-                                    MPI::COMM_WORLD.Send(&state->lamport, 1, MPI::INT, status.Get_source(), AGREE_TAG);
-                                }
-                                break;
-                            case AGREE_TAG:
-                                if (buf > request_clock) {
-                                    replies_received++;
-                                    log(state, "comm: Agree %d received from %d", buf, status.Get_source());
-                                }
-                                break;
-                            default:
-                                log(state, "comm: Unknown message tag %d", status.Get_tag());
-                        }
-                    }
-                    inside = true;
-                    unique_lock<mutex> lck(state->mtx);
-                    state->ready = true;
-                    state->cv.notify_all();
-                    lck.unlock();
-                } else {
-                    // broadcast agree to all in queue
-                    char *repr = (char *)malloc(1024);
-                    *repr = '\0';
-                    for (int p : queue) {
-                        sprintf(repr + strlen(repr), "%d, ", p);
-                    }
-                    state->lamport++;
-                    log(state, "comm: !!! LEFT, %s", repr);
-                    free(repr);
-                    for (int p : queue) {
-                        MPI::COMM_WORLD.Send(&state->lamport, 1, MPI::INT, p, AGREE_TAG);
-                    }
-                    queue.clear();
-                    inside = false;
-                }
-                break;
-            case REQUEST_TAG:
-                if (inside) {
-                    queue.insert(status.Get_source());
-                } else {
-                    MPI::COMM_WORLD.Send(&state->lamport, 1, MPI::INT, status.Get_source(), AGREE_TAG);
-                    state->lamport++;
-                }
-                break;
-            case AGREE_TAG:
-                break;
-            default:
-                log(state, "comm: Unknown message tag %d", status.Get_tag());
-        }
+    if (len > (int) sizeof(line) - 2) {
+        len = sizeof(line) - 2;
     }
+    line[len++] = '\n';
+    fwrite(line, 1, len, stdout);
 }
 
 
 // Main program loop and state machine
 
-void mainloop(struct State *state)
+// Every worker thread of a rank runs it on the same lock
+void mainloop(struct State *state, int worker)
 {
-    int buf = 0;
-    while (1) {
-        int interval = rand() % 8;
-        log(state, "main: Outside sleep: %d", interval);
-        sleep(interval);
-
-        // notify_critical_section();
-        log(state, "main: Sending enter INSIDE");
-        MPI::COMM_WORLD.Send(&buf, 1, MPI::INT, state->rank, INSIDE_TAG);
-
-        // wait_for_enter_critical_section();
-        log(state, "main: Waiting for critical section...");
-        unique_lock<mutex> lck(state->mtx);
-        while (!state->ready) {
-            state->cv.wait(lck);
+    DistributedMutex critical(*state->service, "critical", state->handoff);
+    unsigned seed = rand() + worker;
+    for (int round = 0; !stop_requested && (state->rounds == 0 || round < state->rounds); round++) {
+        int interval = rand_r(&seed) % 8;
+        log(state, "main %d: Outside sleep: %d", worker, interval);
+        usleep(interval * state->pace);
+
+        log(state, "main %d: Waiting for critical section...", worker);
+        while (!critical.try_lock_for(chrono::milliseconds(state->timeout))) {
+            log(state, "main %d: Still waiting for critical section...", worker);
         }
-        lck.unlock();
-        state->ready = false;
 
-        interval = rand() % 8;
-        log(state, "main: !!! ENTERED (sleep: %d)", interval);
-        sleep(interval);
+        interval = rand_r(&seed) % 8;
+        log(state, "main %d: !!! ENTERED (sleep: %d)", worker, interval);
+        usleep(interval * state->pace);
 
-        // exit_critical_section();
-        // log(state, "main: Sending exit INSIDE");
-        MPI::COMM_WORLD.Send(&buf, 1, MPI::INT, state->rank, INSIDE_TAG);
+        log(state, "main %d: !!! LEFT", worker);
+        critical.unlock();
     }
+
+    log(state, "main %d: Done", worker);
 }
 
 
@@ -185,15 +130,23 @@ void mainloop(struct State *state)
 int main(int argc, char **argv)
 {
     int thread_support_provided;
-    mutex mtx;
     struct State state;
 
+    install_stop_handler();
+    block_stop_signals(true);
     MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_support_provided);
 
-    state.ready = false;
     state.rank = MPI::COMM_WORLD.Get_rank();
     state.size = MPI::COMM_WORLD.Get_size();
-    state.lamport = 0;
+    // mpirun -np N ./single.out [rounds [spin [threads [handoff [hierarchical [timeout [pace]]]]]]]
+    // A stress run with many try_lock_for timeouts on one node: 200 0 4 0 1 1 200
+    state.rounds = argc > 1 ? atoi(argv[1]) : 0;
+    int spin = argc > 2 ? atoi(argv[2]) : 0;    // grant polls before parking on the futex
+    int threads = argc > 3 ? atoi(argv[3]) : 1; // worker threads sharing the rank's lock
+    state.handoff = argc > 4 ? atoi(argv[4]) : 0;
+    bool hierarchical = argc > 5 && atoi(argv[5]) != 0; // node leaders compete for their ranks
+    state.timeout = argc > 6 ? atoi(argv[6]) : 2000;
+    state.pace = argc > 7 ? atoi(argv[7]) : 1000000;
     randomize(state.rank);
     if (state.rank == 0) {
         printf("Thread support provided: ", thread_support_provided);
@@ -214,10 +167,22 @@ int main(int argc, char **argv)
         putchar('\n');
     }
 
-    thread t = thread(mpi_thread, &state);
+    // The communication and worker threads are started with the signals still blocked
+    MutexService service(MPI::COMM_WORLD, spin, hierarchical);
+    state.service = &service;
+    vector<thread> workers;
+    for (int i = 1; i < threads; i++) {
+        workers.push_back(thread(mainloop, &state, i));
+    }
+    block_stop_signals(false);
 
-    mainloop(&state);
+    mainloop(&state, 0);
+    for (thread &t : workers) {
+        t.join();
+    }
 
-    t.join();
+    service.shutdown();
+    log(&state, "main: All %d processes on %d nodes finished, %ld messages sent, %ld to other nodes",
+        state.size, service.nodes(), service.sent(), service.sent_off_node());
     MPI::Finalize();
 }
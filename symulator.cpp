@@ -0,0 +1,297 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <queue>
+#include <deque>
+#include <unordered_map>
+#include <getopt.h>
+#include "firma.h"
+#include "opcje.h"
+
+/*
+ * Symulator idiokracji
+ *
+ * Uruchamia N firm z firma.cpp w jednym procesie, w czasie wirtualnym
+ * liczonym w mikrosekundach. Zamiast MPI i watku sterujacego silnik ma jedna
+ * kolejke zdarzen uporzadkowana wg czasu: dostarczenie wiadomosci po czasie
+ * przesylu w sieci oraz koniec odliczania czasu zleconego przez firme. Na
+ * czekanie na idiotow, pobyt w klinice i papierkologie nie trzeba czekac
+ * naprawde, wiec przebieg, ktory w mpirun trwalby godziny, zajmuje sekundy:
+ *
+ *     ./symulator.out -r 20 -l 50 -j 20 1000 50 5
+ *
+ * Wiadomosci miedzy dwiema firmami dochodza w kolejnosci wyslania, tak jak
+ * w MPI. Przy tym samym ziarnie (-z) przebieg jest powtarzalny. Jezeli
+ * kolejka zdarzen opustoszeje, zanim wszystkie firmy skoncza rundy, to
+ * protokol sie zakleszczyl i symulator wypisuje stany firm.
+ *
+*/
+
+// Zdarzenie symulacji
+typedef struct {
+    long long czas;      // Czas wirtualny w us
+    long long kolejnosc; // Kolejnosc zaplanowania, rozstrzyga rowne czasy
+    int cel;             // Firma, ktora obsluzy zdarzenie
+    int zrodlo;          // Nadawca wiadomosci, -1 dla konca odliczania
+    int tag;
+    tmessage message;
+} tzdarzenie;
+
+struct tpozniejszeZdarzenie {
+    bool operator()(const tzdarzenie &a, const tzdarzenie &b) const {
+        return a.czas > b.czas || (a.czas == b.czas && a.kolejnosc > b.kolejnosc);
+    }
+};
+
+typedef struct {
+    std::vector<tfirma> firmy;
+    std::vector<tliczniki> liczniki;
+    std::priority_queue<tzdarzenie, std::vector<tzdarzenie>, tpozniejszeZdarzenie> zdarzenia;
+    long long teraz;                    // Biezacy czas wirtualny w us
+    long long kolejnosc;                // Liczba zaplanowanych zdarzen
+    long long obsluzone;                // Liczba obsluzonych zdarzen
+
+    // Siec
+    int opoznienie;                     // Staly czas przesylu wiadomosci w us
+    int rozrzut;                        // Losowy dodatek do czasu przesylu, od 0 do rozrzut - 1 us
+    unsigned ziarnoSieci;               // Ziarno rand_r() dla rozrzutu, aby nie zmieniac losowan firm
+    std::unordered_map<long long, long long> ostatnia; // Czas dostarczenia ostatniej wiadomosci miedzy para firm
+
+    // Odliczanie czasu, jak w watku sterujacym zlecenia jednej firmy ida po kolei
+    std::vector<long long> odliczanieDo;
+
+    // Liczniki trybu rma, wolne jednostki i kolejka czekajacych (firma, ile chce)
+    int wolne[2];
+    std::deque<std::pair<int, int> > kolejka[2];
+
+    // Zajetosc, czyli calka po czasie wirtualnym liczby firm w kazdym stanie
+    int wStanie[LICZBA_STANOW];
+    double calkaStanow[LICZBA_STANOW];
+} tsymulator;
+
+tsymulator sym;
+
+// SILNIK-----------------------------------------------------------------------
+
+void zaplanuj(tzdarzenie &z) {
+    z.kolejnosc = sym.kolejnosc++;
+    sym.zdarzenia.push(z);
+}
+
+void nadaj(tfirma &f, int cel, int tag, tmessage &message) {
+    long long czas = sym.teraz + sym.opoznienie;
+    if (sym.rozrzut > 0) czas += rand_r(&sym.ziarnoSieci) % sym.rozrzut;
+    long long &ostatnia = sym.ostatnia[(long long) f.id * f.N + cel];
+    if (czas < ostatnia) czas = ostatnia; // Wiadomosc nie moze wyprzedzic wczesniejszej do tej samej firmy
+    ostatnia = czas;
+
+    tzdarzenie z;
+    z.czas = czas;
+    z.cel = cel;
+    z.zrodlo = f.id;
+    z.tag = tag;
+    z.message = message;
+    zaplanuj(z);
+}
+
+void odliczCzas(tfirma &f, int ms) {
+    long long &koniec = sym.odliczanieDo[f.id];
+    koniec = (koniec > sym.teraz ? koniec : sym.teraz) + ms * 1000LL;
+
+    tzdarzenie z;
+    z.czas = koniec;
+    z.cel = f.id;
+    z.zrodlo = -1;
+    z.tag = INSIDE;
+    zaplanuj(z);
+}
+
+double czasSilnika() {
+    return sym.teraz / 1000000.0;
+}
+
+// Operacje na licznikach nie zajmuja czasu wirtualnego, opoznienie ma tylko
+// wiadomosc LICZNIK_WPUSZCZENIE do firmy z kolejki
+int zajmijLicznik(tfirma &f, int z, int ile) {
+    if (!sym.kolejka[z].empty() || sym.wolne[z] == 0) {
+        sym.kolejka[z].push_back(std::make_pair(f.id, ile));
+        return 0;
+    }
+    if (ile > sym.wolne[z]) ile = sym.wolne[z];
+    sym.wolne[z] -= ile;
+    return ile;
+}
+
+void zwolnijLicznik(tfirma &f, int z, int ile) {
+    sym.wolne[z] += ile;
+    while (!sym.kolejka[z].empty() && sym.wolne[z] > 0) {
+        int pid = sym.kolejka[z].front().first;
+        int chce = sym.kolejka[z].front().second;
+        sym.kolejka[z].pop_front();
+        if (chce > sym.wolne[z]) chce = sym.wolne[z];
+        sym.wolne[z] -= chce;
+        wpuscZLicznika(f, z, pid, chce);
+    }
+}
+
+// Firma w STAN_KONIEC nie zleca juz odliczania, wiec symulacja skonczy sie,
+// gdy firmy odpowiedza na ostatnie wiadomosci
+void zakonczPrace(tfirma &f) {
+}
+
+// SYMULACJA--------------------------------------------------------------------
+
+void symuluj() {
+    while (!sym.zdarzenia.empty()) {
+        tzdarzenie z = sym.zdarzenia.top();
+        sym.zdarzenia.pop();
+
+        for (int i = 0; i < LICZBA_STANOW; i++)
+            sym.calkaStanow[i] += (double) sym.wStanie[i] * (z.czas - sym.teraz);
+        sym.teraz = z.czas;
+
+        tfirma &f = sym.firmy[z.cel];
+        int stan = f.stan;
+        if (z.zrodlo < 0)
+            obsluzPobudke(f);
+        else
+            obsluzWiadomosc(f, z.tag, z.message, z.zrodlo);
+        if (f.stan != stan) {
+            sym.wStanie[stan]--;
+            sym.wStanie[f.stan]++;
+        }
+        sym.obsluzone++;
+    }
+}
+
+double czasScienny() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Wyniki wszystkich firm, w tym samym ukladzie co raport benchmarku idiokracji
+void raportSymulacji(double sciennie) {
+    int N = sym.firmy.size();
+    std::vector<long long> opoznienia[2];
+    opoznienia[ZASOB_KLINIKA].assign(KUBELKI_OPOZNIEN, 0);
+    opoznienia[ZASOB_OKNO].assign(KUBELKI_OPOZNIEN, 0);
+    long long wiadomosci = 0;
+    double czas = 0;
+    for (int i = 0; i < N; i++) {
+        tfirma &f = sym.firmy[i];
+        for (int z = 0; z < 2; z++)
+            for (int k = 0; k < KUBELKI_OPOZNIEN; k++)
+                opoznienia[z][k] += f.opoznienia[z][k];
+        wiadomosci += f.wyslane;
+        if (f.czasPracy > czas) czas = f.czasPracy;
+    }
+
+    tfirma &f = sym.firmy[0];
+    printf("Symulacja: N = %d, K = %d, L = %d, rund %d, czas wirtualny %.3f s, przesyl %d us + do %d us\n",
+           N, f.K, f.L, f.rundy, czas, sym.opoznienie, sym.rozrzut > 0 ? sym.rozrzut - 1 : 0);
+    wypiszWyniki(f, czas, opoznienia, wiadomosci, -1);
+
+    double T = sym.teraz > 0 ? (double) sym.teraz : 1.0;
+    printf("srednio firm: czeka na klinike %.2f, w klinice %.2f, czeka na okienko %.2f, przy okienku %.2f\n",
+           sym.calkaStanow[STAN_2A] / T, sym.calkaStanow[STAN_2B] / T,
+           sym.calkaStanow[STAN_3] / T, sym.calkaStanow[STAN_4] / T);
+    printf("zdarzen %lld w %.3f s, %.0f zdarzen/s\n", sym.obsluzone, sciennie,
+           sciennie > 0 ? sym.obsluzone / sciennie : 0.0);
+
+    int niegotowe = sym.wStanie[STAN_KONIEC] == N ? 0 : N - sym.wStanie[STAN_KONIEC];
+    if (niegotowe > 0) {
+        printf("ZAKLESZCZENIE: %d firm nie skonczylo rund:", niegotowe);
+        for (int i = 0; i < N; i++)
+            if (sym.firmy[i].stan != STAN_KONIEC)
+                printf(" <%d> %s", i, opisStanu[sym.firmy[i].stan]);
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+// MAIN-------------------------------------------------------------------------
+
+int main(int argc, char * argv[]) {
+    topcje o;
+    domyslneOpcje(o);
+    o.poziom = POZIOM_BRAK; // Symulator nie prowadzi dziennika
+
+    int opcja;
+    bool dobrze = true;
+    while ((opcja = getopt(argc, argv, "c:wqtar:s:I:C:O:X:l:j:z:")) != -1)
+        if (!opcjaKrotka(o, opcja, optarg)) dobrze = false;
+
+    if (argc - optind == 3) { // N, K i L mozna tez podac w konfiguracji
+        dobrze = ustawOpcje(o, "firmy", argv[optind]) && dobrze;
+        dobrze = ustawOpcje(o, "miejsca", argv[optind + 1]) && dobrze;
+        dobrze = ustawOpcje(o, "okienka", argv[optind + 2]) && dobrze;
+    }
+    else if (argc - optind != 0)
+        dobrze = false;
+    if (o.rundy == 0 && o.sekundy == 0) o.rundy = 10; // Symulacja musi sie skonczyc
+    if (o.wezly > 0) {
+        fprintf(stderr, "Zle parametry: symulator nie ma wezlow, wezly dzialaja tylko w idiokracji\n");
+        dobrze = false;
+    }
+
+    if (!dobrze || !sprawdzOpcje(o, o.N)) {
+        printf("\nNie uruchomiono prawidlowo symulatora.\n"
+               "Prawidlowe uruchomienie to:\n%s [-c plik] [-w | -q | -a] [-t] [-r rundy | -s sekundy] [-I ms] [-C ms] [-O ms]\n"
+               "    [-X idioci] [-l us] [-j us] [-z ziarno] <N> <K> <L>\n"
+               "Gdzie N- liczba firm, K- miejsca w klinice, L- liczba okien\n"
+               "-c- plik konfiguracji jak w idiokracji, N, K i L moga byc w nim zamiast w argumentach\n"
+               "-w, -q, -a, -t- tryby kliniki i okienek jak w idiokracji\n"
+               "-r, -s- kazda firma wykonuje tyle rund (domyslnie 10) albo pracuje tyle sekund czasu wirtualnego\n"
+               "-I, -C, -O- maksymalny czas w ms oczekiwania na idiotow, pobytu w klinice i papierkologii (domyslnie %d, %d, %d)\n"
+               "-X- idiotow przychodzi od 1 do X - 1 (domyslnie %d)\n"
+               "-l, -j- czas przesylu wiadomosci to l us (domyslnie 50) plus losowo od 0 do j - 1 us\n"
+               "-z- ziarno losowania, przy tym samym ziarnie przebieg jest ten sam\n",
+               argv[0], max_wait_i, max_wait_k, max_wait_o, max_idiots);
+        return -1;
+    }
+
+    int N = o.N;
+    srand(o.ziarno);
+    sym.ziarnoSieci = o.ziarno;
+    sym.opoznienie = o.opoznienie;
+    sym.rozrzut = o.rozrzut;
+    sym.teraz = 0;
+    sym.kolejnosc = 0;
+    sym.obsluzone = 0;
+    sym.odliczanieDo.assign(N, 0);
+    sym.wolne[ZASOB_KLINIKA] = o.K;
+    sym.wolne[ZASOB_OKNO] = o.L;
+    for (int i = 0; i < LICZBA_STANOW; i++) {
+        sym.wStanie[i] = 0;
+        sym.calkaStanow[i] = 0;
+    }
+
+    sym.firmy.resize(N);
+    sym.liczniki.resize(N);
+    for (int i = 0; i < N; i++) {
+        tfirma &f = sym.firmy[i];
+        f.id = i;
+        f.N = N;
+        ustawFirme(f, o);
+        f.rozsylanieBlokujace = false;
+        f.monitor = -1;
+        f.benchmark = true;
+        f.czasStartu = 0;
+        f.czasKonca = o.sekundy;
+        inicjujBenchmark(f);
+        inicjujFirme(f);
+        podlaczLiczniki(f, &sym.liczniki[i]);
+    }
+    ustawObsluge(sym.firmy[0]);
+
+    double start = czasScienny();
+    for (int i = 0; i < N; i++) {
+        uruchomFirme(sym.firmy[i]);
+        sym.wStanie[sym.firmy[i].stan]++;
+    }
+    symuluj();
+    raportSymulacji(czasScienny() - start);
+    return 0;
+}